@@ -3,9 +3,11 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <string>
 #include <cstdint>
 #include <boost/optional.hpp>
+#include <boost/container/small_vector.hpp>
 #include <mutex>
 #ifndef NO_THREADS
 #include <boost/thread/shared_mutex.hpp>
@@ -14,6 +16,9 @@
 #include <set>
 #include <unordered_set>
 #include "Util.hpp"
+#include "Symbol.hpp"
+#include "DecisionTree.hpp"
+#include "TileCodec.hpp"
 
 using namespace std;
 namespace Tang {
@@ -86,10 +91,25 @@ inline string to_string(ConfigBit b)
 ConfigBit cbit_from_str(const string &s);
 
 class CRAMView;
+struct PackedCRAM;
 
 struct ChangedBit;
 typedef vector<ChangedBit> CRAMDelta;
 
+// A BitGroup in the form of a PackedCRAM: for each 64-bit word holding bits of the group, the bits that must be set
+// and the bits that must be clear for the group to match
+struct BitGroupMask
+{
+    struct Word
+    {
+        int frame;
+        int word;
+        uint64_t ones;
+        uint64_t zeros;
+    };
+    boost::container::small_vector<Word, 2> words;
+};
+
 // A BitGroup is a list of configuration bits that correspond to a given setting
 struct BitGroup
 {
@@ -100,14 +120,33 @@ struct BitGroup
     // Delta should be calculated as (with feature) - (without feature)
     explicit BitGroup(const CRAMDelta &delta);
 
-    set<ConfigBit> bits;
+    // Most groups have only a few bits, which are stored inline
+    static const size_t inline_bits = 4;
+
+    // Sorted with no duplicates. Call build_mask again after changing bits directly
+    boost::container::small_vector<ConfigBit, inline_bits> bits;
+
+    // Packed form used to match against a PackedCRAM, shared between copies of the group
+    shared_ptr<const BitGroupMask> mask;
+
+    // Add a bit, keeping bits sorted
+    void add_bit(const ConfigBit &bit);
+
+    // Build the packed form of a group with more than inline_bits bits. The database does this for every group it
+    // holds; other groups, and small groups, are matched against a PackedCRAM bit by bit
+    void build_mask();
 
     // Return true if the BitGroup is set in a tile
     bool match(const CRAMView &tile) const;
 
+    bool match(const PackedCRAM &tile) const;
+
     // Update a coverage set with the bitgroup
     void add_coverage(BitSet &known_bits, bool value = true) const;
 
+    // Update a coverage mask, of the same size as the tile, with the bitgroup
+    void add_coverage(PackedCRAM &known_bits, bool value = true) const;
+
     // Set the BitGroup in a tile
     void set_group(CRAMView &tile) const;
 
@@ -129,8 +168,8 @@ istream &operator>>(istream &out, BitGroup &bits);
 // An arc is a configurable connection between two nodes, defined within a mux
 struct ArcData
 {
-    string source;
-    string sink;
+    Symbol source;
+    Symbol sink;
     BitGroup bits;
 
     inline bool operator==(const ArcData &other) const
@@ -142,18 +181,22 @@ struct ArcData
 // A mux specifies all the possible source node arcs driving a sink node
 struct MuxBits
 {
-    string sink;
-    map<string, ArcData> arcs;
+    Symbol sink;
+    // Kept in source name order, which decides between equally good matches in get_driver
+    map<Symbol, ArcData, SymbolNameLess> arcs;
 
     // Get a list of sources for the mux
     vector<string> get_sources() const;
 
     // Work out which connection inside the mux, if any, is made inside a tile
-    boost::optional<string>
+    boost::optional<Symbol>
     get_driver(const CRAMView &tile, boost::optional<BitSet &> coverage = boost::optional<BitSet &>()) const;
 
+    // As above for a packed tile, with coverage as a mask of the same size as the tile
+    boost::optional<Symbol> get_driver(const PackedCRAM &tile, PackedCRAM *coverage = nullptr) const;
+
     // Set the driver to a given value inside the tile
-    void set_driver(CRAMView &tile, const string &driver) const;
+    void set_driver(CRAMView &tile, Symbol driver) const;
 
     inline bool operator==(const MuxBits &other) const
     {
@@ -174,7 +217,7 @@ istream &operator>>(istream &in, MuxBits &mux);
 
 struct WordSettingBits
 {
-    string name;
+    Symbol name;
     vector<BitGroup> bits;
     vector<bool> defval;
 
@@ -182,6 +225,8 @@ struct WordSettingBits
     boost::optional<vector<bool>>
     get_value(const CRAMView &tile, boost::optional<BitSet &> coverage = boost::optional<BitSet &>()) const;
 
+    boost::optional<vector<bool>> get_value(const PackedCRAM &tile, PackedCRAM *coverage = nullptr) const;
+
     // Set the word value in a tile
     void set_value(CRAMView &tile, const vector<bool> &value) const;
 
@@ -199,9 +244,10 @@ istream &operator>>(istream &out, WordSettingBits &ws);
 
 struct EnumSettingBits
 {
-    string name;
-    map<string, BitGroup> options;
-    boost::optional<string> defval;
+    Symbol name;
+    // Kept in option name order, which decides between equally good matches in get_value
+    map<Symbol, BitGroup, SymbolNameLess> options;
+    boost::optional<Symbol> defval;
 
     // Needed for Python
     void set_defval(string val);
@@ -211,11 +257,13 @@ struct EnumSettingBits
     vector<string> get_options() const;
 
     // Get the value of the enumeration, returning empty if not set or set to default, if default is non-empty
-    boost::optional<string>
+    boost::optional<Symbol>
     get_value(const CRAMView &tile, boost::optional<BitSet &> coverage = boost::optional<BitSet &>()) const;
 
+    boost::optional<Symbol> get_value(const PackedCRAM &tile, PackedCRAM *coverage = nullptr) const;
+
     // Set the value of the enumeration in a tile
-    void set_value(CRAMView &tile, const string &value) const;
+    void set_value(CRAMView &tile, Symbol value) const;
 
     inline bool operator==(const EnumSettingBits &other) const
     {
@@ -232,8 +280,8 @@ istream &operator>>(istream &out, EnumSettingBits &es);
 // A fixed connection inside a tile
 struct FixedConnection
 {
-    string source;
-    string sink;
+    Symbol source;
+    Symbol sink;
 
     inline bool operator==(const FixedConnection &other) const
     {
@@ -244,13 +292,9 @@ struct FixedConnection
 
 inline bool operator<(const FixedConnection &a, const FixedConnection &b)
 {
-    if (a.sink < b.sink) {
-        return true;
-    } else if (a.sink > b.sink) {
-        return false;
-    } else {
-        return a.source < b.source;
-    }
+    if (a.sink != b.sink)
+        return a.sink.str() < b.sink.str();
+    return SymbolNameLess()(a.source, b.source);
 }
 
 // Write fixed connection to output
@@ -260,12 +304,85 @@ ostream &operator<<(ostream &out, const FixedConnection &es);
 istream &operator>>(istream &out, FixedConnection &es);
 
 
+// A batch of additions to a TileBitDatabase, applied together by TileBitDatabase::apply
+struct BitDatabaseBatch
+{
+    vector<ArcData> arcs;
+    vector<WordSettingBits> words;
+    vector<EnumSettingBits> enums;
+    vector<FixedConnection> fixed_conns;
+
+    bool empty() const;
+};
+
 struct TileConfig;
 struct TileLocator;
 struct TileInfo;
 
 class RoutingGraph;
 
+// The contents of a TileBitDatabase, with the name-sorted lists and decision trees used for decoding and saving
+struct BitDatabaseTables
+{
+    BitDatabaseTables() = default;
+
+    // The sorted lists and trees refer to entries, so a copy builds its own
+    BitDatabaseTables(const BitDatabaseTables &other);
+
+    BitDatabaseTables &operator=(const BitDatabaseTables &other) = delete;
+
+    // Keyed by symbol for fast lookup
+    map<Symbol, MuxBits> muxes;
+    map<Symbol, WordSettingBits> words;
+    map<Symbol, EnumSettingBits> enums;
+    map<Symbol, set<FixedConnection>> fixed_conns;
+    vector<const MuxBits *> sorted_muxes;
+    vector<const WordSettingBits *> sorted_words;
+    vector<const EnumSettingBits *> sorted_enums;
+
+    // Muxes and enums compiled for decoding, with candidates in the order get_driver and get_value prefer them
+    struct MuxDecision
+    {
+        DecisionTree tree;
+        vector<const ArcData *> arcs;
+    };
+    struct EnumDecision
+    {
+        DecisionTree tree;
+        vector<const pair<const Symbol, BitGroup> *> options;
+    };
+    map<Symbol, MuxDecision> mux_decisions;
+    map<Symbol, EnumDecision> enum_decisions;
+    // Parallel to sorted_muxes and sorted_enums, so decoding needs no lookups
+    vector<const MuxDecision *> sorted_mux_decisions;
+    vector<const EnumDecision *> sorted_enum_decisions;
+
+    // Generated codec for the database file as loaded, cleared by any change
+    const TileCodec *codec = nullptr;
+
+    void config_to_tile_cram(const TileConfig &cfg, CRAMView &tile, bool is_tilegroup, set<string> *tg_matches) const;
+
+    TileConfig tile_cram_to_config(const CRAMView &tile) const;
+
+    vector<pair<string, bool>> get_downhill_wires(Symbol wire) const;
+
+    // Fixed connections, sorted by sink name
+    vector<FixedConnection> sorted_fixed_conns() const;
+
+    // Rebuild the sorted lists and every decision tree
+    void rebuild();
+
+    // Rebuild the sorted lists after entries are added or removed, once every mux and enum has been compiled
+    void sort_entries();
+
+    // Rebuild the decision tree for a mux or enum after it changes
+    void compile_mux(Symbol sink);
+
+    void compile_enum(Symbol name);
+};
+
+class FrozenTileBitDatabase;
+
 class TileBitDatabase
 {
 public:
@@ -277,30 +394,31 @@ public:
     TileConfig tile_cram_to_config(const CRAMView &tile) const;
 
     // All these functions are designed to be thread safe during fuzzing and database modification
-    // Maybe we should have faster unsafe versions too, as that will be the majority of the use cases?
+    // For decoding and encoding only, freeze() gives a faster snapshot without locking or copies
     vector<string> get_sinks() const;
 
-    MuxBits get_mux_data_for_sink(const string &sink) const;
+    MuxBits get_mux_data_for_sink(Symbol sink) const;
 
     vector<string> get_settings_words() const;
 
-    WordSettingBits get_data_for_setword(const string &name) const;
+    WordSettingBits get_data_for_setword(Symbol name) const;
 
     vector<string> get_settings_enums() const;
 
-    EnumSettingBits get_data_for_enum(const string &name) const;
+    EnumSettingBits get_data_for_enum(Symbol name) const;
 
     vector<FixedConnection> get_fixed_conns() const;
     // TODO: function to get routing graph of tile
 
     // Get a list of wires downhill in the tile of a given wire
     // Returns pair<wire, configurable>
-    vector<pair<string, bool>> get_downhill_wires(const string &wire) const;
+    vector<pair<string, bool>> get_downhill_wires(Symbol wire) const;
 
     // Add the bit database for a tile to the routing graph
     void add_routing(const TileInfo &tile, RoutingGraph &graph) const;
 
     // Add relevant items to the database
+    // Each of these is a batch of one, it is much faster to add many items with apply
     void add_mux_arc(const ArcData &arc);
 
     void add_setting_word(const WordSettingBits &wsb);
@@ -309,13 +427,24 @@ public:
 
     void add_fixed_conn(const FixedConnection &conn);
 
-    void remove_fixed_sink(const string &sink);
-    void remove_setting_enum(const string &enum_name);
-    void remove_setting_word(const string &word_name);
+    // Add a batch of items under a single lock. The whole batch is checked for conflicts, against the database and
+    // against earlier items in the batch, before anything is changed, so if DatabaseConflictError is thrown the
+    // database is left as it was. Additions are appended to a journal next to the database file, which is replayed
+    // on load and compacted into the database file by save, on destruction after a change, or once it grows large.
+    // Removals are journalled too
+    void apply(const BitDatabaseBatch &batch);
+
+    void remove_fixed_sink(Symbol sink);
+    void remove_setting_enum(Symbol enum_name);
+    void remove_setting_word(Symbol word_name);
 
     // Save the bit database to file
     void save();
 
+    // Return an immutable snapshot of the database as it is now. This is cheap, but the next change to the database
+    // copies it while the snapshot is still alive
+    shared_ptr<const FrozenTileBitDatabase> freeze() const;
+
     // Function to obtain the singleton BitDatabase for a given tile
     friend shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile);
 
@@ -333,13 +462,76 @@ private:
     mutable boost::shared_mutex db_mutex;
     atomic<bool> dirty{false};
 #endif
-    map<string, MuxBits> muxes;
-    map<string, WordSettingBits> words;
-    map<string, EnumSettingBits> enums;
-    map<string, set<FixedConnection>> fixed_conns;
+    // Shared with frozen snapshots, and copied before a change if any snapshot still holds it
+    shared_ptr<BitDatabaseTables> tables;
     string filename;
 
+    size_t journal_records = 0;
+
     void load();
+
+    string journal_filename() const;
+
+    void replay_journal();
+
+    // Throw DatabaseConflictError if a batch conflicts with the database or itself
+    void check_batch(const BitDatabaseBatch &batch) const;
+
+    // Add a checked batch, optionally recording the changes in the journal
+    void apply_batch(const BitDatabaseBatch &batch, bool write_journal);
+
+    // Remove a word, enum or fixed sink given its journal record type, optionally recording the removal
+    void remove_entry(const string &record, Symbol name, bool write_journal);
+
+    // Append records to the journal, compacting it into the database file once it grows large
+    void write_journal_records(const string &text, size_t records);
+
+    // Write the database file and clear the journal, must be called with the database locked for writing
+    void write_database();
+
+    // Make sure no snapshot shares the tables and stop using any generated codec, must be called with the database
+    // locked for writing before any change, and only once there is sure to be one
+    void make_tables_writable();
+};
+
+/*
+A FrozenTileBitDatabase is an immutable snapshot of a TileBitDatabase, for decoding and encoding where the database
+is not being changed. It needs no locking and its accessors return references rather than copies.
+*/
+class FrozenTileBitDatabase
+{
+public:
+    void config_to_tile_cram(const TileConfig &cfg, CRAMView &tile, bool is_tilegroup = false, set<string> *tg_matches = nullptr) const;
+
+    TileConfig tile_cram_to_config(const CRAMView &tile) const;
+
+    // Entries in name order
+    const vector<const MuxBits *> &get_muxes() const;
+
+    const vector<const WordSettingBits *> &get_words() const;
+
+    const vector<const EnumSettingBits *> &get_enums() const;
+
+    const vector<FixedConnection> &get_fixed_conns() const;
+
+    const MuxBits &get_mux_data_for_sink(Symbol sink) const;
+
+    const WordSettingBits &get_data_for_setword(Symbol name) const;
+
+    const EnumSettingBits &get_data_for_enum(Symbol name) const;
+
+    vector<pair<string, bool>> get_downhill_wires(Symbol wire) const;
+
+    // The generated codec used for this database, if any
+    const TileCodec *get_codec() const;
+
+private:
+    friend class TileBitDatabase;
+
+    explicit FrozenTileBitDatabase(shared_ptr<const BitDatabaseTables> tables);
+
+    shared_ptr<const BitDatabaseTables> tables;
+    vector<FixedConnection> fixed_conns;
 };
 
 // Represents a conflict while adding something to the database
@@ -35,6 +35,25 @@ class Bitstream
     // Serialise a Chip back to a bitstream
     static Bitstream serialise_chip(const Chip &chip, const std::map<std::string, std::string> options);
 
+    // Serialise a Chip straight to a .bit file, giving the same output as serialise_chip followed by write_bit.
+    // Frames are encoded in parallel where threads are available and written out in order as they are done, so the
+    // whole bitstream is never held in memory
+    static void write_chip_bit(const Chip &chip, const std::map<std::string, std::string> options, std::ostream &out);
+
+    // The parts of a serialised Chip, as put together by serialise_chip: everything before the configuration frames,
+    // the block holding one frame and everything after the frames
+    static std::vector<uint8_t> serialise_header(const Chip &chip);
+    static std::vector<uint8_t> serialise_frame(const Chip &chip, int frame);
+    static std::vector<uint8_t> serialise_trailer();
+    // Pack the bits of one frame into the bytes carried by its block, MSB first. out needs room for bits / 8 bytes
+    static void pack_frame(const Chip &chip, int frame, uint8_t *out);
+    // Unpack the bytes of a frame block into the Chip's CRAM, marking occupied columns. The Chip's occupancy must
+    // already be sized for its CRAM, and be finalised once every frame is unpacked
+    static void unpack_frame(Chip &chip, int frame, const uint8_t *bytes, size_t count);
+
+    // Continue the bitstream CRC16 over a buffer, before the final 16 bits are pushed out
+    static uint16_t crc16(const uint8_t *data, size_t size, uint16_t crc = 0);
+
     // Deserialise a bitstream to a Chip
     Chip deserialise_chip();
   private:
@@ -0,0 +1,58 @@
+#ifndef LIBTANG_BITSTREAMDIFF_HPP
+#define LIBTANG_BITSTREAMDIFF_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "CRAM.hpp"
+#include "TileConfig.hpp"
+
+using namespace std;
+
+namespace Tang {
+
+class Chip;
+
+struct DiffOptions
+{
+    // Only compare configuration content, ignoring bitstream metadata such as comments and CRCs, for checking that
+    // two bitstreams are equivalent
+    bool ignore_metadata = false;
+    // Decode changed tiles in both chips to report arc, word and enum differences
+    bool decode_tiles = false;
+};
+
+// The differences within a single tile
+struct TileDiff
+{
+    string name;
+    string type;
+    // Changed bits, relative to the tile
+    CRAMDelta bits;
+    // Only filled in when decoding tiles: settings only in the first or only in the second chip
+    TileConfig removed;
+    TileConfig added;
+};
+
+// The differences between two chips of the same device
+struct ChipDiff
+{
+    // Frames that differ
+    vector<int> changed_frames;
+    // Tiles that differ, by name
+    map<string, TileDiff> tiles;
+    // Changed bits that do not belong to any tile, relative to the chip
+    CRAMDelta unowned_bits;
+    // Differences outside of the CRAM, as descriptive text
+    vector<string> other;
+
+    bool empty() const;
+};
+
+// Compare two chips. Frames are compared as packed words, skipping frames unoccupied in both, and every changed bit is
+// attributed to the tiles that own it
+ChipDiff diff_chips(const Chip &a, const Chip &b, const DiffOptions &options = DiffOptions());
+
+}
+
+#endif //LIBTANG_BITSTREAMDIFF_HPP
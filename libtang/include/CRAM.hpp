@@ -4,6 +4,12 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#ifndef NO_THREADS
+#include <atomic>
+#include <mutex>
+#endif
 
 using namespace std;
 namespace Tang {
@@ -19,6 +25,50 @@ struct ChangedBit {
 
 typedef vector<ChangedBit> CRAMDelta;
 
+// A copy of a region of CRAM packed 64 bits to a word, with each frame starting on a new word
+// This is used where many bits must be hashed or compared at once
+struct PackedCRAM {
+    int frame_count = 0;
+    int bit_count = 0;
+    int words_per_frame = 0;
+    vector<uint64_t> words;
+
+    inline bool get_bit(int frame, int bit) const {
+        return ((words[frame * words_per_frame + bit / 64] >> (bit % 64)) & 1) != 0;
+    }
+
+    // Return a 64-bit hash of the packed bits and dimensions
+    uint64_t hash() const;
+
+    inline bool operator==(const PackedCRAM &other) const {
+        return (frame_count == other.frame_count) && (bit_count == other.bit_count) && (words == other.words);
+    }
+};
+
+// Counts the writes to a CRAM, shared by the CRAM and its views, so that a summary built from the CRAM can tell
+// whether it has changed since. A summary records the count, making it odd; a write only increments an odd count, so
+// writes are a plain read of the count until a summary needs to know about them
+class CRAMGeneration {
+public:
+    // Note a write, or a possible write through a reference that was handed out
+    inline void changed() {
+        if (count & 1)
+            count++;
+    }
+
+    // Return the current count, for a summary to compare with later
+    uint64_t record();
+
+    uint64_t current() const;
+
+private:
+#ifdef NO_THREADS
+    uint64_t count = 0;
+#else
+    atomic<uint64_t> count{0};
+#endif
+};
+
 // This represents a view into the configuration memory, typically used to represent a tile
 class CRAMView {
 public:
@@ -39,11 +89,15 @@ public:
     // Clear the CRAM region
     void clear();
 
+    // Pack the CRAM region into 64-bit words, reusing the storage in out
+    void pack(PackedCRAM &out) const;
+
     friend CRAMDelta operator-(const CRAMView &a, const CRAMView &b);
 
 private:
     // Private constructor, CRAM::make_view should always be used
-    CRAMView(shared_ptr<vector<vector<char>>> data, int frame_offset, int bit_offset, int frame_count, int bit_count);
+    CRAMView(shared_ptr<vector<vector<char>>> data, shared_ptr<CRAMGeneration> generation, int frame_offset,
+             int bit_offset, int frame_count, int bit_count);
 
     int frame_offset;
     int bit_offset;
@@ -53,6 +107,7 @@ private:
     friend class CRAM;
 
     shared_ptr<vector<vector<char>>> cram_data;
+    shared_ptr<CRAMGeneration> generation;
 };
 
 CRAMDelta operator-(const CRAMView &a, const CRAMView &b);
@@ -64,7 +119,7 @@ public:
     // Construct empty CRAM given size
     CRAM(int frames, int bits);
 
-    // Access a bit in the CRAM given frame and bit offset
+    // Access a bit in the CRAM given frame and bit offset. This counts as a write, use get_bit to only read
     char &bit(int frame, int bit) const;
 
     // Primarily for Python use
@@ -78,12 +133,151 @@ public:
     // Return number of bits per frame in CRAM
     int bits() const;
 
+    // Pack a frame into 64-bit words, out must have room for (bits() + 63) / 64 words
+    void pack_frame(int frame, uint64_t *out) const;
+
     // Make a view to the CRAM given frame and bit offset; and frames and bits per frame in the view
     CRAMView make_view(int frame_offset, int bit_offset, int frame_count, int bit_count);
 
     // Using a shared_ptr so views are not invalidated even if the CRAM itself is deleted
     // A vector of type char is used as the optimisations in vector<bool> are not worth the loss of bool& etc
     shared_ptr<vector<vector<char>>> data;
+
+    // Shared with views. Writes made through data directly are not counted, so must be followed by
+    // generation->changed()
+    shared_ptr<CRAMGeneration> generation;
+};
+
+// A summary of which 64-bit columns of each frame contain set bits, so that regions of CRAM can be found to be
+// all zero without walking their bits. The summary describes the CRAM as it was when the summary was built, and is
+// no longer valid once the CRAM is written.
+class CRAMOccupancy {
+public:
+    // Construct an invalid (not yet built) summary
+    CRAMOccupancy();
+
+    // Construct a summary of an all-zero CRAM given size
+    CRAMOccupancy(int frames, int bits);
+
+    // Mark a 64-bit column of a frame as containing set bits
+    void mark(int frame, int column);
+
+    // Must be called after marking columns of a CRAM and before queries
+    void finalise(const CRAM &cram);
+
+    // Build the summary by scanning a CRAM
+    void scan(const CRAM &cram);
+
+    // Return true if the summary has been built and its CRAM has not been written since
+    bool valid() const;
+
+    bool column_nonzero(int frame, int column) const;
+
+    bool frame_nonzero(int frame) const;
+
+    // Return true if no bit can be set in the region. This works at column granularity, so a false result means
+    // only that the region may contain set bits
+    bool region_zero(int frame_offset, int bit_offset, int frame_count, int bit_count) const;
+
+private:
+    int frame_count = 0;
+    int column_count = 0;
+    bool finalised = false;
+    shared_ptr<CRAMGeneration> source;
+    uint64_t source_generation = 0;
+    // Frame-major, one entry per column
+    vector<uint8_t> nonzero;
+    // Column-major, count of nonzero frames in the column before each frame
+    vector<uint32_t> prefix;
+};
+
+// A store of distinct compressed frames, shared by the CRAMSnapshots made with it so that a frame appearing in many
+// snapshots is only held once. A frame is encoded as 64-bit words with runs of zero words left out: repeated
+// (zero words skipped, literal word count, literal words), counts as LEB128 varints. An all-zero frame is empty.
+class CRAMFramePool {
+public:
+    CRAMFramePool();
+
+    // Return the id of an encoded frame, adding it to the pool if it is new. Id 0 is always the empty frame
+    uint32_t intern(const vector<uint8_t> &encoded);
+
+    // Decode a frame into words_per_frame words
+    void decode(uint32_t id, uint64_t *out, int words_per_frame) const;
+
+    // XOR a frame into words_per_frame words
+    void decode_xor(uint32_t id, uint64_t *out, int words_per_frame) const;
+
+    // Decode only the word at index word of a frame
+    uint64_t decode_word(uint32_t id, int word, int words_per_frame) const;
+
+    // Return the number of distinct frames
+    size_t size() const;
+
+    // Return the approximate number of bytes used by the pool
+    size_t memory_usage() const;
+
+    // Encode words_per_frame words
+    static void encode(const uint64_t *words, int words_per_frame, vector<uint8_t> &out);
+
+private:
+    // A deque so references to frames stay valid as more are added
+    deque<vector<uint8_t>> frames;
+    unordered_multimap<uint64_t, uint32_t> index;
+    size_t encoded_bytes = 0;
+#ifndef NO_THREADS
+    mutable mutex pool_mutex;
+#endif
+    const vector<uint8_t> &get(uint32_t id) const;
+};
+
+/*
+An immutable compressed copy of a CRAM, for keeping many versions of a chip in memory at once. A snapshot either
+holds a pool id for every frame, or is made against a base snapshot and holds only the frames that differ from it,
+each stored as its XOR with the base frame. Frames are deduplicated through the shared CRAMFramePool.
+
+A snapshot made against a snapshot that itself has a base is stored against that base instead, so reading a frame
+never goes through more than one base. Single frames and bits can be read without decompressing anything else.
+*/
+class CRAMSnapshot {
+public:
+    // Snapshot a CRAM, adding its frames to a pool that may be shared with other snapshots
+    explicit CRAMSnapshot(const CRAM &cram, shared_ptr<CRAMFramePool> pool = make_shared<CRAMFramePool>());
+
+    // Snapshot a CRAM as its differences from base, sharing the base's pool. The CRAM must be the same size as base
+    CRAMSnapshot(const CRAM &cram, shared_ptr<const CRAMSnapshot> base);
+
+    int frames() const;
+
+    int bits() const;
+
+    // Read one frame into (bits() + 63) / 64 words, laid out as by CRAM::pack_frame
+    void get_frame(int frame, uint64_t *out) const;
+
+    bool get_bit(int frame, int bit) const;
+
+    // Return true if the frame is stored as a difference from the base snapshot
+    bool frame_changed(int frame) const;
+
+    // Decompress to a new CRAM
+    CRAM to_cram() const;
+
+    // Decompress into an existing CRAM of the same size
+    void restore(CRAM &cram) const;
+
+    // Return the approximate number of bytes used by this snapshot, not counting its pool or base
+    size_t memory_usage() const;
+
+    shared_ptr<CRAMFramePool> pool;
+    shared_ptr<const CRAMSnapshot> base;
+
+private:
+    int frame_count;
+    int bit_count;
+    int words_per_frame;
+    // Without a base, the pool id of each frame
+    vector<uint32_t> frame_ids;
+    // With a base, (frame, pool id of XOR with the base frame) for each changed frame, sorted by frame
+    vector<pair<uint32_t, uint32_t>> changed;
 };
 }
 #endif //LIBTANG_CRAM_HPP
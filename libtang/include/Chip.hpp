@@ -7,7 +7,9 @@
 #include <cstdint>
 #include <map>
 #include <set>
+#include <boost/range/iterator_range.hpp>
 #include "CRAM.hpp"
+#include "Symbol.hpp"
 
 using namespace std;
 namespace Tang {
@@ -27,6 +29,10 @@ struct ChipInfo
 };
 
 class Tile;
+class TileIndex;
+
+// A non-owning view of a run of tiles of a Chip, valid for the lifetime of the Chip
+typedef boost::iterator_range<vector<Tile *>::const_iterator> TileSpan;
 
 // A difference between two Chips
 // A list of pairs mapping between tile identifier (name:type) and tile difference
@@ -50,6 +56,19 @@ public:
     // The chip's configuration memory
     CRAM cram;
 
+    // Summary of the set bits in cram, built by Bitstream::deserialise_chip or update_occupancy
+    CRAMOccupancy occupancy;
+
+    // Rebuild the occupancy summary. Any write to the cram, or to a tile's view of it, stops the summary being used
+    // until it is rebuilt
+    void update_occupancy();
+
+    // Return true if no bit in a tile is set
+    bool is_tile_zero(const Tile &tile) const;
+
+    // Return true if a tile has the same bits as the same region of another chip of the same device,
+    // such as one holding the default configuration
+    bool is_tile_equal(const Tile &tile, const Chip &other) const;
 
     // Tile access
     shared_ptr<Tile> get_tile_by_name(string name);
@@ -60,13 +79,39 @@ public:
 
     vector<shared_ptr<Tile>> get_all_tiles();
 
-    string get_tile_by_position_and_type(int row, int col, string type);
+    string get_tile_by_position_and_type(int row, int col, const string &type) const;
+
+    string get_tile_by_position_and_type(int row, int col, const set<string> &type) const;
+
+    // Indexed tile access, without copying or reference counting
+    // All tiles of a type, in name order
+    TileSpan get_tile_span_by_type(Symbol type) const;
+
+    // All tiles at a location, in tilegrid order
+    TileSpan get_tile_span_by_position(int row, int col) const;
 
-    string get_tile_by_position_and_type(int row, int col, set<string> type);
+    // All tiles in the rectangle between (row0, col0) and (row1, col1) inclusive, as one span per row
+    vector<TileSpan> get_tile_spans_in_region(int row0, int col0, int row1, int col1) const;
 
     // Map tile name to a tile reference
     map<string, shared_ptr<Tile>> tiles;         
 
+    // Index from CRAM coordinates to tiles, shared between all chips of a device
+    shared_ptr<const TileIndex> tile_index;
+
+    // Tiles in the order of their tile_index IDs
+    vector<shared_ptr<Tile>> indexed_tiles;
+
+    // Tiles in tile_index type and location order, backing the tile spans
+    vector<Tile *> tiles_by_type;
+    vector<Tile *> tiles_by_location;
+
+    // Return the tiles owning a CRAM bit, usually only one
+    vector<shared_ptr<Tile>> get_tiles_at_bit(int frame, int bit) const;
+
+    // Return the tiles covering any frame in [first_frame, last_frame]
+    vector<shared_ptr<Tile>> get_tiles_in_frames(int first_frame, int last_frame) const;
+
     // Miscellaneous information
     uint32_t usercode = 0x00000000;
     uint32_t cfg1 = 0x00000000; // TODO
@@ -76,7 +121,6 @@ public:
     uint32_t cfg_ca = 0x00000000; // TODO
     vector<string> metadata;
 
-    vector<vector<vector<pair<string, string>>>> tiles_at_location;
     // Block RAM initialisation
     map<uint8_t, vector<uint8_t>> bram_data;
     // PLL data
@@ -88,6 +132,9 @@ public:
     int get_max_col() const;
 };
 
+// Compare two Chips of the same device, tile by tile
+ChipDelta operator-(const Chip &a, const Chip &b);
+
 }
 
 #endif //LIBTANG_CHIP_HPP
@@ -11,6 +11,7 @@ using namespace std;
 namespace Tang {
 
 class Chip;
+class TileDecodeCache;
 
 // A group of tiles to configure at once for a particular feature that is split across tiles
 // TileGroups are currently for non-routing configuration only
@@ -20,6 +21,8 @@ struct TileGroup
     TileConfig config;
 };
 
+struct ChipConfigUpdate;
+
 // This represents the configuration of a chip at a high level
 class ChipConfig
 {
@@ -38,8 +41,29 @@ public:
 
     string to_string() const;
     static ChipConfig from_string(const string &config);
+    // Parse configuration text held in memory, without copying it
+    static ChipConfig from_text(const char *begin, const char *end);
+    static ChipConfig from_file(const string &filename);
     Chip to_chip() const;
+    // Parse configuration text and build its chip. Where threads are available the chip is constructed while the
+    // text is parsed, as the device is named at the top of the config
+    static Chip text_to_chip(const char *begin, const char *end);
     static ChipConfig from_chip(const Chip &chip);
+    // As above, but also decode the configuration of every tile, using a cache to share work between identical tiles
+    static ChipConfig from_chip(const Chip &chip, TileDecodeCache &cache);
+    // Decode a chip given a previous chip of the same device and its decoded configuration. Only tiles in frames
+    // that differ between the two chips are decoded again. The previous tiles are reused in place, so pass the
+    // previous configuration with std::move unless it is still needed
+    static ChipConfigUpdate from_chip_incremental(const Chip &prev, ChipConfig prev_config, const Chip &chip,
+                                                  TileDecodeCache *cache = nullptr);
+};
+
+// The result of an incremental decode
+struct ChipConfigUpdate
+{
+    ChipConfig config;
+    // Names of tiles whose bits differ from the previous chip
+    vector<string> changed_tiles;
 };
 
 }
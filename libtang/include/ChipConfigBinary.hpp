@@ -0,0 +1,73 @@
+#ifndef LIBTANG_CHIPCONFIGBINARY_HPP
+#define LIBTANG_CHIPCONFIGBINARY_HPP
+
+#include "ChipConfig.hpp"
+#include "TileConfig.hpp"
+#include "Symbol.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+
+using namespace std;
+
+namespace Tang {
+
+/*
+A compact binary encoding of a ChipConfig, for flows that never look at the textual config. Counts, indices and sizes
+are unsigned LEB128 varints and strings are a varint length followed by the bytes.
+
+    "TCFG" version
+    symbols:    count, name...              every arc, word and enum name, referred to by index
+    header:     device package metadata sysconfig
+    bram, pll:  count, (index size bytes)...
+    tilegroups: count, (tile names, tile record)...
+    tiles:      count, (name offset size)...   directory in name order, offsets into the tile data
+    tile data:  size, tile records
+
+A tile record is its arcs as (sink source) symbol pairs, its words as (name bit-count packed-bits) with bits packed
+least significant first, its enums as (name value) symbol pairs and its unknown bits as (frame bit). The directory
+lets single tiles be read without decoding the rest of the file.
+*/
+class BinaryChipConfig
+{
+public:
+    static const uint32_t version = 1;
+
+    // Encode a configuration
+    static string encode(const ChipConfig &cc);
+
+    // Return true if a buffer starts with the binary format's magic
+    static bool is_binary(const char *begin, const char *end);
+
+    // Read the header and tile directory of an encoded configuration. The buffer is not copied and must outlive this
+    // object
+    BinaryChipConfig(const char *begin, const char *end);
+
+    // Names of the configured tiles, in name order
+    vector<string> tile_names() const;
+    bool has_tile(const string &name) const;
+    // Decode a single tile, throwing out_of_range if it has no configuration
+    TileConfig read_tile(const string &name) const;
+
+    // Decode everything
+    ChipConfig decode() const;
+
+private:
+    struct TileEntry
+    {
+        boost::string_ref name;
+        const char *begin, *end;
+    };
+
+    vector<Symbol> symbols;
+    // Everything except tiles, which are only decoded when asked for
+    ChipConfig header;
+    vector<TileEntry> tiles;
+
+    const TileEntry *find_tile(const string &name) const;
+};
+
+}
+
+#endif // LIBTANG_CHIPCONFIGBINARY_HPP
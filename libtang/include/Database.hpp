@@ -6,6 +6,7 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <boost/functional/hash.hpp>
 using namespace std;
 
 namespace Tang {
@@ -52,12 +53,24 @@ struct TileInfo;
 
 vector<TileInfo> get_device_tilegrid(const DeviceLocator &part);
 
+// Obtain the index from CRAM coordinates to tiles for a part
+// TileIndexes are built once per device and shared
+class TileIndex;
+shared_ptr<const TileIndex> get_device_tile_index(const DeviceLocator &part);
+
+// As above, but if the index is not yet built, build it from a tilegrid the caller has already loaded
+shared_ptr<const TileIndex> get_device_tile_index(const DeviceLocator &part, const vector<TileInfo> &tilegrid);
+
 
 // Obtain the BitDatabase for a device/tile combination
 // BitDatabases are a singleton
 class TileBitDatabase;
 shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile);      
 
+// Load the BitDatabases for every tile type of a device up front, in parallel where threads are available,
+// rather than on first use
+void preload_device_databases(const DeviceLocator &part);
+
 }
 
 // Hash function for TileLocator
@@ -65,8 +78,11 @@ namespace std {
 template<> struct hash<Tang::TileLocator> {
 public:
     inline size_t operator()(const Tang::TileLocator &tile) const {
-        hash<string> hash_fn;
-        return hash_fn(tile.family) + hash_fn(tile.device) + hash_fn(tile.tiletype);
+        size_t seed = 0;
+        boost::hash_combine(seed, tile.family);
+        boost::hash_combine(seed, tile.device);
+        boost::hash_combine(seed, tile.tiletype);
+        return seed;
     }
 };
 
@@ -0,0 +1,63 @@
+#ifndef LIBTANG_DECISIONTREE_HPP
+#define LIBTANG_DECISIONTREE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+
+namespace Tang {
+
+struct BitGroup;
+class CRAMView;
+struct PackedCRAM;
+
+/*
+A DecisionTree finds the first of a list of BitGroups, in priority order, that matches a tile. Rather than matching
+every group in turn, it tests single bits chosen to rule out as many groups as possible, then matches the few groups
+left in full, so the result is always the same as matching the whole list in order.
+
+The tree refers to the BitGroups it was built from, which must outlive it and not be changed.
+*/
+class DecisionTree
+{
+public:
+    DecisionTree() = default;
+
+    // Build a tree for a list of candidate groups, highest priority first
+    explicit DecisionTree(const vector<const BitGroup *> &candidates);
+
+    // Return the index of the first matching candidate, or -1 if none match
+    int first_match(const CRAMView &tile) const;
+
+    int first_match(const PackedCRAM &tile) const;
+
+    // Number of nodes, including leaves
+    size_t size() const;
+
+private:
+    // A branch tests a bit and continues at next[value]; a leaf, with frame < 0, matches the candidates in
+    // leaf_candidates[next[0], next[1]) in full
+    struct Node
+    {
+        int frame;
+        int bit;
+        uint32_t next[2];
+    };
+
+    vector<Node> nodes;
+    vector<uint32_t> leaf_candidates;
+    vector<const BitGroup *> groups;
+
+    // Add the subtree for a set of candidates, given the (frame, bit) positions already tested above it
+    uint32_t build(const vector<uint32_t> &cands, vector<pair<int, int>> &tested, int depth);
+
+    uint32_t add_leaf(const vector<uint32_t> &cands);
+
+    template <typename TileT> int walk(const TileT &tile) const;
+};
+
+}
+
+#endif //LIBTANG_DECISIONTREE_HPP
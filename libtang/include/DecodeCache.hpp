@@ -0,0 +1,90 @@
+#ifndef LIBTANG_DECODECACHE_HPP
+#define LIBTANG_DECODECACHE_HPP
+
+#include <string>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <mutex>
+#include "CRAM.hpp"
+#include "Database.hpp"
+
+using namespace std;
+
+namespace Tang {
+
+struct TileConfig;
+class Tile;
+
+/*
+A TileDecodeCache memoises tile_cram_to_config by tile type and the content of the tile's CRAM. Most tiles in a design
+are identical to many others of the same type (unused tiles especially), so decoding a whole chip through the cache
+is mostly packing and hashing.
+
+Cached configs are shared between all tiles with the same content and must not be modified.
+*/
+class TileDecodeCache
+{
+public:
+    // Create a cache holding at most max_entries decoded tiles
+    explicit TileDecodeCache(size_t max_entries = 4096);
+
+    // Decode a tile, using the cached config if one exists for identical CRAM content
+    shared_ptr<const TileConfig> decode(const Tile &tile);
+
+    shared_ptr<const TileConfig> decode(const TileLocator &loc, const CRAMView &cram);
+
+    // Statistics
+    size_t hits() const;
+
+    size_t misses() const;
+
+    double hit_rate() const;
+
+    size_t size() const;
+
+    // Remove all entries and reset statistics
+    void clear();
+
+private:
+    struct Key
+    {
+        TileLocator loc;
+        uint64_t hash;
+
+        inline bool operator==(const Key &other) const
+        {
+            return (hash == other.hash) && (loc == other.loc);
+        }
+    };
+
+    struct KeyHash
+    {
+        inline size_t operator()(const Key &key) const
+        {
+            return size_t(key.hash) ^ hash<string>()(key.loc.tiletype);
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        PackedCRAM bits;
+        shared_ptr<const TileConfig> config;
+    };
+
+    size_t max_entries;
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    // Most recently used entries are at the front
+    list<Entry> entries;
+    unordered_map<Key, list<Entry>::iterator, KeyHash> index;
+#ifndef NO_THREADS
+    mutable mutex cache_mutex;
+#endif
+};
+
+}
+
+#endif //LIBTANG_DECODECACHE_HPP
@@ -0,0 +1,29 @@
+#ifndef LIBTANG_HEXCODEC_HPP
+#define LIBTANG_HEXCODEC_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+namespace Tang {
+
+// Append bytes to a string as lower case hex digits, with no separators
+void append_hex(string &out, const uint8_t *data, size_t size);
+
+// Append bytes as hex the way .bram_init data is written: a space after each byte, or a newline after every
+// bytes_per_line bytes
+void append_hex_lines(string &out, const uint8_t *data, size_t size, size_t bytes_per_line = 32);
+
+/*
+Decode the hex data of a record such as .bram_init, starting at begin and stopping at the start of the next record (a
+token beginning with '.') or at end. Each whitespace separated token is one or more bytes of two digits, in either
+case, and comments are skipped. Lines in the layout written by append_hex_lines with 32 bytes per line are decoded 32
+bytes at a time. Returns where decoding stopped, throwing runtime_error on anything that is not hex.
+*/
+const char *decode_hex_record(const char *begin, const char *end, vector<uint8_t> &out);
+
+}
+
+#endif // LIBTANG_HEXCODEC_HPP
@@ -0,0 +1,138 @@
+#ifndef LIBTANG_METRICS_HPP
+#define LIBTANG_METRICS_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#ifndef NO_THREADS
+#include <atomic>
+#endif
+
+using namespace std;
+
+namespace Tang {
+
+// Phases nest, so their times overlap: block parsing includes CRC checks and unpacking, Chip construction includes
+// tilegrid loading, and tile decode and encode include any database loads they cause. CRC is only timed while
+// reading, as frames are checksummed a byte at a time as they are serialised
+enum class Phase
+{
+    DATABASE_LOAD,
+    TILEGRID_LOAD,
+    CHIP_CONSTRUCTION,
+    BLOCK_PARSE,
+    CRC,
+    UNPACK,
+    TILE_DECODE,
+    TILE_ENCODE,
+    SERIALISE,
+    WRITE,
+    NUM_PHASES,
+};
+
+enum class Counter
+{
+    BYTES_READ,
+    BYTES_WRITTEN,
+    FRAMES_READ,
+    FRAMES_WRITTEN,
+    TILES_DECODED,
+    TILES_ENCODED,
+    TILE_CACHE_HITS,
+    TILE_CACHE_MISSES,
+    PACK_CACHE_HITS,
+    PACK_CACHE_MISSES,
+    // Only counted in programs that replace operator new to do so, as the tools do
+    ALLOCATIONS,
+    NUM_COUNTERS,
+};
+
+/*
+Process-wide phase timers and counters, printed by the tools' --stats option. Nothing is recorded until enable() is
+called, and while disabled each timer or counter costs a test of one flag. Enable or disable only while no other
+threads are using the library.
+*/
+class Metrics
+{
+public:
+    static void enable(bool on = true);
+
+    static inline bool enabled()
+    {
+        return is_enabled;
+    }
+
+    static inline void add(Counter counter, uint64_t n = 1)
+    {
+        if (is_enabled)
+            counters[size_t(counter)] += n;
+    }
+
+    static void add_time(Phase phase, chrono::steady_clock::duration time);
+
+    static uint64_t count(Counter counter);
+
+    static uint64_t phase_calls(Phase phase);
+
+    static double phase_seconds(Phase phase);
+
+    // Zero all timers and counters
+    static void reset();
+
+    static const char *name(Phase phase);
+
+    static const char *name(Counter counter);
+
+    // All timers and counters, and the time since enable(), as a table or a JSON object
+    static string report(bool json = false);
+
+private:
+#ifdef NO_THREADS
+    typedef uint64_t value_t;
+#else
+    typedef atomic<uint64_t> value_t;
+#endif
+    static bool is_enabled;
+    static chrono::steady_clock::time_point enable_time;
+    static value_t counters[size_t(Counter::NUM_COUNTERS)];
+    static value_t phase_ns[size_t(Phase::NUM_PHASES)];
+    static value_t phase_count[size_t(Phase::NUM_PHASES)];
+};
+
+// Times a phase from construction until stop() or destruction
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase), running(Metrics::enabled())
+    {
+        if (running)
+            start = chrono::steady_clock::now();
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    ~PhaseTimer()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        if (running) {
+            running = false;
+            Metrics::add_time(phase, chrono::steady_clock::now() - start);
+        }
+    }
+
+private:
+    Phase phase;
+    bool running;
+    chrono::steady_clock::time_point start;
+};
+
+}
+
+#endif //LIBTANG_METRICS_HPP
@@ -0,0 +1,58 @@
+#ifndef LIBTANG_PACKCACHE_HPP
+#define LIBTANG_PACKCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+namespace Tang {
+
+class Chip;
+
+/*
+A PackCache keeps the encoded configuration frames of the last Chip packed with it, so that repacking a design after
+a small change only encodes the frames that changed. Each frame is packed and compared byte for byte against the
+cached one; frames that match are copied from the cache and skip the CRC, which is most of the cost of encoding.
+
+The header and trailer are always encoded again, and a cache for a chip with different frame geometry is ignored, so
+the output is always identical to serialise_chip followed by write_bit.
+
+    "TPKC" version num_frames frame_bytes     all uint32, little endian
+    frame blocks                              num_frames blocks as they appear in the bitstream
+*/
+class PackCache
+{
+public:
+    static const uint32_t version = 1;
+
+    // Load a cache saved by save. Returns false, leaving the cache empty, if the file is missing or not a usable cache
+    bool load(const string &filename);
+
+    void save(const string &filename) const;
+
+    // Serialise a chip to the contents of a .bit file, reusing cached frames where they are unchanged, and update the
+    // cache to hold this chip's frames
+    string pack(const Chip &chip);
+
+    // Statistics for the last pack
+    size_t frames_reused() const;
+
+    size_t frames_encoded() const;
+
+private:
+    uint32_t num_frames = 0;
+    uint32_t frame_bytes = 0;
+    // The frame section of the bitstream, num_frames blocks of block_bytes() each
+    vector<uint8_t> frames;
+    size_t reused_count = 0;
+    size_t encoded_count = 0;
+
+    size_t block_bytes() const;
+    void clear();
+};
+
+}
+
+#endif //LIBTANG_PACKCACHE_HPP
@@ -0,0 +1,164 @@
+#ifndef LIBTANG_SCANNER_HPP
+#define LIBTANG_SCANNER_HPP
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <stdexcept>
+#include <boost/utility/string_ref.hpp>
+
+using namespace std;
+
+namespace Tang {
+
+// Read a whole file into a buffer, returning false if it cannot be opened
+inline bool read_file(const string &filename, string &buffer)
+{
+    ifstream in(filename, ios::binary);
+    if (!in)
+        return false;
+    in.seekg(0, ios::end);
+    streamoff size = in.tellg();
+    in.seekg(0, ios::beg);
+    buffer.resize(size_t(size));
+    if (size > 0)
+        in.read(&buffer[0], size);
+    return bool(in);
+}
+
+/*
+A Scanner tokenises text held in memory. It follows the same rules as the istream helpers in Util.hpp and
+istream >> string, so a parser can be converted from one to the other without changing what it accepts, but works
+directly on a pointer and returns tokens without copying them.
+*/
+class Scanner
+{
+public:
+    Scanner(const char *begin, const char *end) : pos(begin), end(end)
+    {}
+
+    explicit Scanner(const string &text) : Scanner(text.data(), text.data() + text.size())
+    {}
+
+    // Next character, or EOF at the end of the text
+    inline int peek() const
+    {
+        return (pos == end) ? EOF : (unsigned char)(*pos);
+    }
+
+    // Skip whitespace, optionally including newlines
+    inline void skip_blank(bool nl = false)
+    {
+        while (pos != end && (*pos == ' ' || *pos == '\t' || (nl && (*pos == '\n' || *pos == '\r'))))
+            ++pos;
+    }
+
+    // Return true if end of line (or text), comments count as end of line
+    inline bool check_eol()
+    {
+        skip_blank(false);
+        if (pos != end && *pos == '#') {
+            while (pos != end && *pos != '\n')
+                ++pos;
+            return true;
+        }
+        return (pos == end || *pos == '\n');
+    }
+
+    // Skip past blank lines and comments
+    inline void skip()
+    {
+        skip_blank(true);
+        while (pos != end && *pos == '#') {
+            check_eol();
+            skip_blank(true);
+        }
+    }
+
+    // Return true if at the end of a record (or text)
+    inline bool check_eor()
+    {
+        skip();
+        return (pos == end || *pos == '.');
+    }
+
+    // Return true if at the end of the text
+    inline bool check_eof()
+    {
+        skip();
+        return pos == end;
+    }
+
+    // Read the next whitespace delimited token, empty at the end of the text
+    inline boost::string_ref token()
+    {
+        while (pos != end && is_space(*pos))
+            ++pos;
+        const char *start = pos;
+        while (pos != end && !is_space(*pos))
+            ++pos;
+        return boost::string_ref(start, size_t(pos - start));
+    }
+
+    // Read the rest of the current line, not including the newline, and move to the start of the next
+    inline boost::string_ref line()
+    {
+        const char *start = pos;
+        while (pos != end && *pos != '\n')
+            ++pos;
+        boost::string_ref result(start, size_t(pos - start));
+        if (pos != end)
+            ++pos;
+        return result;
+    }
+
+    // The current position, so that part of the text can be handed to a specialised decoder and scanning resumed
+    // where it stopped
+    inline const char *position() const
+    {
+        return pos;
+    }
+
+    inline void seek(const char *p)
+    {
+        pos = p;
+    }
+
+    // Parse an unsigned decimal number at the start of a token, advancing past it
+    static inline bool parse_uint(const char *&p, const char *tok_end, int &value)
+    {
+        if (p == tok_end || *p < '0' || *p > '9')
+            return false;
+        int64_t result = 0;
+        while (p != tok_end && *p >= '0' && *p <= '9') {
+            result = result * 10 + (*p - '0');
+            if (result > INT32_MAX)
+                return false;
+            ++p;
+        }
+        value = int(result);
+        return true;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+
+    static inline bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+};
+
+// Next token of a record, which must be present
+inline boost::string_ref record_token(Scanner &sc)
+{
+    boost::string_ref tok = sc.token();
+    if (tok.empty())
+        throw runtime_error("unexpected end of config text");
+    return tok;
+}
+
+}
+
+#endif //LIBTANG_SCANNER_HPP
@@ -0,0 +1,160 @@
+#ifndef LIBTANG_SYMBOL_HPP
+#define LIBTANG_SYMBOL_HPP
+
+#include <string>
+#include <iostream>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <boost/optional.hpp>
+#include <boost/utility/string_ref.hpp>
+
+using namespace std;
+
+namespace Tang {
+
+/*
+A Symbol is an interned name, such as a wire, tile type or setting name, represented by a compact integer ID.
+
+Symbols are held in a process-wide table and are never freed, so the string for a Symbol stays valid for the lifetime
+of the program. Equality and the default ordering compare IDs only; use SymbolNameLess where the order of the names
+themselves matters. Conversion to and from strings is only needed at text input and output.
+*/
+class Symbol
+{
+public:
+    // The empty symbol
+    Symbol() = default;
+
+    // Intern a name, returning the existing symbol if it was seen before
+    Symbol(const string &name);
+
+    Symbol(const char *name);
+
+    // Intern a name without first copying it into a string, as used by parsers
+    explicit Symbol(boost::string_ref name);
+
+    // Return the symbol for a name if it has been interned, without adding it to the table
+    static boost::optional<Symbol> find(const string &name);
+
+    // Number of symbols interned so far
+    static size_t count();
+
+    const string &str() const;
+
+    inline operator const string &() const
+    {
+        return str();
+    }
+
+    inline uint32_t index() const
+    {
+        return id;
+    }
+
+    inline bool empty() const
+    {
+        return id == 0;
+    }
+
+    // Equality, and an order of interning which is only useful as a key order
+    friend inline bool operator==(const Symbol &a, const Symbol &b)
+    {
+        return a.id == b.id;
+    }
+
+    friend inline bool operator!=(const Symbol &a, const Symbol &b)
+    {
+        return a.id != b.id;
+    }
+
+    friend inline bool operator<(const Symbol &a, const Symbol &b)
+    {
+        return a.id < b.id;
+    }
+
+private:
+    uint32_t id = 0;
+};
+
+// Orders symbols by name, for containers that must iterate in name order
+struct SymbolNameLess
+{
+    inline bool operator()(const Symbol &a, const Symbol &b) const
+    {
+        return a != b && a.str() < b.str();
+    }
+};
+
+/*
+A SymbolCache remembers the names a parser has recently interned, so that names repeated throughout a file are found
+without taking the lock on the shared symbol table. Each name maps to a single slot, and a new name simply replaces
+whatever was there. Slots refer to the interned names rather than the text being parsed, so one cache can be kept and
+reused for any number of texts.
+*/
+class SymbolCache
+{
+public:
+    SymbolCache() : slots(slot_count)
+    {}
+
+    inline Symbol get(boost::string_ref name)
+    {
+        // FNV-1a, which is cheap for the short names found in configs
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : name)
+            hash = (hash ^ uint8_t(c)) * 1099511628211ULL;
+        auto &slot = slots[hash & (slot_count - 1)];
+        if (slot.first != name) {
+            Symbol sym(name);
+            slot = make_pair(boost::string_ref(sym.str()), sym);
+        }
+        return slot.second;
+    }
+
+private:
+    static const size_t slot_count = 8192;
+    vector<pair<boost::string_ref, Symbol>> slots;
+};
+
+ostream &operator<<(ostream &out, const Symbol &sym);
+
+// Read a whitespace delimited name and intern it
+istream &operator>>(istream &in, Symbol &sym);
+
+inline string operator+(const string &a, const Symbol &b)
+{
+    return a + b.str();
+}
+
+inline string operator+(const Symbol &a, const string &b)
+{
+    return a.str() + b;
+}
+
+inline string operator+(const char *a, const Symbol &b)
+{
+    return a + b.str();
+}
+
+inline string operator+(const Symbol &a, const char *b)
+{
+    return a.str() + b;
+}
+
+}
+
+namespace std {
+template<>
+struct hash<Tang::Symbol>
+{
+public:
+    inline size_t operator()(const Tang::Symbol &sym) const
+    {
+        return hash<uint32_t>()(sym.index());
+    }
+};
+}
+
+#endif //LIBTANG_SYMBOL_HPP
@@ -0,0 +1,84 @@
+#ifndef LIBTANG_SYNTHETIC_HPP
+#define LIBTANG_SYNTHETIC_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+#include "Chip.hpp"
+#include "Database.hpp"
+
+using namespace std;
+
+namespace Tang {
+
+class FrozenTileBitDatabase;
+
+enum class SyntheticContent
+{
+    EMPTY,
+    // A fraction of bits set at random
+    SPARSE,
+    // Every bit set or clear at random
+    RANDOM,
+    // A random selection of each tile's settings, as a placed design would have
+    STRUCTURED,
+};
+
+enum class SyntheticCorruption
+{
+    NONE,
+    // A bit of one frame's data flipped, so its CRC no longer matches
+    FRAME,
+    // A bit of one frame's CRC flipped
+    CRC,
+    // The bitstream cut short inside the frame data
+    TRUNCATE,
+};
+
+struct SyntheticOptions
+{
+    SyntheticContent content = SyntheticContent::SPARSE;
+    // Fraction of bits set by SPARSE content
+    double density = 0.01;
+    // Number of BRAM blocks and PLLs given random payloads. These appear in configs made from the chip, but not in
+    // bitstreams as serialise_chip does not write memory data
+    int bram_blocks = 0;
+    int plls = 0;
+    SyntheticCorruption corruption = SyntheticCorruption::NONE;
+};
+
+/*
+A SyntheticGenerator makes Chips and bitstreams with made-up content, for testing and benchmarking without the vendor
+tools. Output depends only on the device, the options and the seed. A single Chip is refilled for each seed, so
+tiles are only built once however many bitstreams are generated.
+*/
+class SyntheticGenerator
+{
+public:
+    SyntheticGenerator(const DeviceLocator &device, const SyntheticOptions &options);
+
+    // Fill the chip with the content for a seed. The chip is reused by the next call
+    const Chip &make_chip(uint64_t seed);
+
+    // Return the contents of a .bit file for a seed, serialised with serialise_chip and then corrupted if asked for
+    string make_bitstream(uint64_t seed);
+
+private:
+    SyntheticOptions options;
+    Chip chip;
+    // Bit databases for STRUCTURED content, by tile type
+    map<string, shared_ptr<const FrozenTileBitDatabase>> tile_dbs;
+    // Bytes before the first frame block in a serialised chip, excluding metadata
+    size_t header_bytes = 0;
+};
+
+// Write a database for every device in a devices.json to root, with a tilegrid for each device and bit databases of
+// made-up settings for a few tile types per family. Any database tool can then run on synthetic bitstreams for any
+// device geometry without the vendor database. devices_file may be root's own devices.json
+void write_synthetic_database(const string &root, const string &devices_file);
+
+}
+
+#endif //LIBTANG_SYNTHETIC_HPP
@@ -9,18 +9,19 @@
 #include <cassert>
 #include <map>
 #include "CRAM.hpp"
+#include "Symbol.hpp"
 
 namespace Tang {
 
 // Basic information about a tile
 struct TileInfo {
-    string family;
+    Symbol family;
     string device;
     size_t max_col;
     size_t max_row;
 
     string name;
-    string type;
+    Symbol type;
     size_t num_frames;
     size_t bits_per_frame;
     size_t frame_offset;
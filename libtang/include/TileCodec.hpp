@@ -0,0 +1,116 @@
+#ifndef LIBTANG_TILECODEC_HPP
+#define LIBTANG_TILECODEC_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "Symbol.hpp"
+
+using namespace std;
+
+namespace Tang {
+
+class CRAMView;
+struct PackedCRAM;
+struct TileConfig;
+
+/*
+A TileCodec is a decoder and encoder for one tile type, generated at build time from its bits.db when libtang is
+configured with TANG_GENERATE_CODECS (see tools/gen_tile_codecs.py). A TileBitDatabase uses the codec generated from
+exactly the file it loaded, recognised by its hash, until the database is changed; otherwise, or if a codec cannot
+handle a tile, the generic path through the database is used.
+
+The generated functions give exactly the same results as TileBitDatabase::tile_cram_to_config and
+config_to_tile_cram.
+*/
+struct TileCodec
+{
+    const char *family;
+    const char *tile_type;
+    // database_hash of the bits.db the codec was generated from
+    uint64_t db_hash;
+    // Smallest tile the codec can be used with, big enough to hold every bit in the database
+    int frames;
+    int bits;
+
+    // Decode a packed tile. Returns false where the generic path must be used instead
+    bool (*decode)(const PackedCRAM &tile, TileConfig &cfg);
+
+    // Encode a configuration outside a tile group. Returns false, possibly having changed some bits of the tile,
+    // where the generic path must be used instead; it makes the same changes first, so gives the same result
+    bool (*encode)(const TileConfig &cfg, CRAMView &tile);
+};
+
+// Hash of the text of a bits.db file, identifying the codec generated from it
+uint64_t database_hash(const string &text);
+
+// Return the generated codec for a database, or nullptr if there is none. Identical databases in several families
+// share the codec generated for the first of them
+const TileCodec *find_tile_codec(uint64_t db_hash);
+
+// All generated codecs, empty unless built with TANG_GENERATE_CODECS
+vector<const TileCodec *> get_tile_codecs();
+
+// Generated codecs are used by default; disabling them forces the generic path, for comparison
+void set_tile_codecs_enabled(bool enabled);
+
+bool tile_codecs_enabled();
+
+// Add the known bit count and unknown bits of a decoded tile to its config, given the coverage of the bits matched
+// by settings, as the final step of decoding
+void add_unknown_bits(const PackedCRAM &tile, const uint64_t *coverage, TileConfig &cfg);
+
+// Support for generated code
+
+// Kinds of entry in a CodecIndex
+enum class CodecEntry
+{
+    ARC, WORD, ENUM, OPTION
+};
+
+// Maps settings, by name, to their numbers in a generated codec. Built once, on first use, from the codec's names
+struct CodecIndex
+{
+    struct Key
+    {
+        CodecEntry kind;
+        uint32_t first;
+        uint32_t second;
+        int32_t value;
+    };
+
+    // Names are numbered in order; keys refer to them by number, with second unused for words and enums
+    CodecIndex(const char *const *names, size_t name_count, const Key *keys, size_t key_count);
+
+    vector<Symbol> symbols;
+
+    // Number of an entry, or -1 if the database has no such entry
+    int find(CodecEntry kind, Symbol first, Symbol second = Symbol()) const;
+
+private:
+    unordered_map<uint64_t, int32_t> entries;
+
+    static uint64_t pack(CodecEntry kind, Symbol first, Symbol second);
+};
+
+// Functions generated for each tile type, used by codec_encode
+struct CodecEncoder
+{
+    const CodecIndex &(*index)();
+    size_t word_count;
+    size_t enum_count;
+    // Set an arc, a word or an enum option; set_word returns false if the value has the wrong size
+    void (*set_arc)(int arc, CRAMView &tile);
+    bool (*set_word)(int word, const vector<bool> &value, CRAMView &tile);
+    void (*set_option)(int option, CRAMView &tile);
+    // Apply the defaults of the words and enums not found in the config; returns false if one cannot be applied
+    bool (*set_defaults)(const vector<char> &found_words, const vector<char> &found_enums, CRAMView &tile);
+};
+
+// Encode a config through generated functions, in the same order as TileBitDatabase::config_to_tile_cram
+bool codec_encode(const CodecEncoder &encoder, const TileConfig &cfg, CRAMView &tile);
+
+}
+
+#endif //LIBTANG_TILECODEC_HPP
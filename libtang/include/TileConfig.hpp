@@ -6,17 +6,20 @@
 #include <vector>
 #include <map>
 #include <iostream>
+#include "Symbol.hpp"
 
 using namespace std;
 
 namespace Tang {
+class Scanner;
+
 // This represents configuration at FASM level, in terms of routing arcs and non-routing configuration settings -
 // either words or enums.
 
 // A connection in a tile
 struct ConfigArc {
-    string sink;
-    string source;
+    Symbol sink;
+    Symbol source;
     inline bool operator==(const ConfigArc &other) const {
         return other.source == source && other.sink == sink;
     }
@@ -28,7 +31,7 @@ istream &operator>>(istream &in, ConfigArc &arc);
 
 // A configuration setting in a tile that takes one or more bits (such as LUT init)
 struct ConfigWord {
-    string name;
+    Symbol name;
     vector<bool> value;
     inline bool operator==(const ConfigWord &other) const {
         return other.name == name && other.value == value;
@@ -41,8 +44,8 @@ istream &operator>>(istream &in, ConfigWord &cw);
 
 // A configuration setting in a tile that takes an enumeration value (such as IO type)
 struct ConfigEnum {
-    string name;
-    string value;
+    Symbol name;
+    Symbol value;
     inline bool operator==(const ConfigEnum &other) const {
         return other.name == name && other.value == value;
     }
@@ -71,9 +74,9 @@ struct TileConfig {
     vector<ConfigUnknown> cunknowns;
     int total_known_bits = 0;
 
-    void add_arc(const string &sink, const string &source);
-    void add_word(const string &name, const vector<bool> &value);
-    void add_enum(const string &name, const string &value);
+    void add_arc(Symbol sink, Symbol source);
+    void add_word(Symbol name, const vector<bool> &value);
+    void add_enum(Symbol name, Symbol value);
     void add_unknown(int frame, int bit);
 
     string to_string() const;
@@ -86,6 +89,9 @@ ostream &operator<<(ostream &out, const TileConfig &tc);
 
 istream &operator>>(istream &in, TileConfig &ce);
 
+// Read the records of a tile configuration from text held in memory, accepting the same input as operator>>
+void scan_tile_config(Scanner &sc, TileConfig &tc, SymbolCache &symbols);
+
 }
 
 #endif //LIBTANG_TILECONFIG_HPP
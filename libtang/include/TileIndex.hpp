@@ -0,0 +1,76 @@
+#ifndef LIBTANG_TILEINDEX_HPP
+#define LIBTANG_TILEINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "Tile.hpp"
+
+using namespace std;
+
+namespace Tang {
+
+/*
+A TileIndex maps CRAM coordinates back to the tiles that own them. It is built once per device from the tilegrid,
+see get_device_tile_index, and shared between all Chips of that device.
+
+Tiles are identified by their position in the index, which is in order of tile name (the same order as Chip::tiles).
+*/
+class TileIndex
+{
+public:
+    TileIndex(const vector<TileInfo> &tiles, int frames);
+
+    // Number of tiles in the index
+    size_t size() const;
+
+    // Tile information given tile ID
+    const TileInfo &info(size_t id) const;
+
+    // Return the IDs of all tiles owning the CRAM bit (frame, bit), usually only one, in O(log n)
+    vector<size_t> tiles_at_bit(int frame, int bit) const;
+
+    // Return the IDs of all tiles covering any frame in [first_frame, last_frame], in O(log n) plus the number of
+    // tiles found
+    vector<size_t> tiles_in_frames(int first_frame, int last_frame) const;
+
+    // IDs grouped by tile type, so the tiles of one type are contiguous
+    const vector<uint32_t> &type_order() const;
+
+    // Range [first, last) of type_order() holding the tiles of a type, empty if there are none
+    pair<size_t, size_t> type_range(Symbol type) const;
+
+    // IDs grouped by location, row major, in tilegrid order within a location
+    const vector<uint32_t> &location_order() const;
+
+    // Range [first, last) of location_order() holding the tiles at (row, col), empty if outside the grid
+    pair<size_t, size_t> location_range(int row, int col) const;
+
+    // Size of the location grid
+    int rows() const;
+    int cols() const;
+
+private:
+    vector<TileInfo> tiles;
+    int frames;
+    // For each frame, IDs of the tiles covering it sorted by bit offset, in compressed row form
+    vector<uint32_t> frame_start;
+    vector<uint32_t> frame_tiles;
+    // Widest tile in each frame, bounding how far back a bit lookup must search
+    vector<uint32_t> frame_max_bits;
+    // IDs sorted by first frame, and the most frames covered by any tile
+    vector<uint32_t> by_first_frame;
+    size_t max_frames = 0;
+    // IDs grouped by type, and the range of each type
+    vector<uint32_t> by_type;
+    map<Symbol, pair<size_t, size_t>> type_ranges;
+    // IDs grouped by location, with the start of each location in compressed row form
+    int grid_rows = 0, grid_cols = 0;
+    vector<uint32_t> by_location;
+    vector<uint32_t> location_start;
+};
+
+}
+
+#endif //LIBTANG_TILEINDEX_HPP
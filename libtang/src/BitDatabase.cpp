@@ -2,36 +2,45 @@
 #include "CRAM.hpp"
 #include "TileConfig.hpp"
 #include "Tile.hpp"
+#include "Scanner.hpp"
+#include "Metrics.hpp"
 //#include "RoutingGraph.hpp"
 
 #include <algorithm>
 #include <fstream>
+#include <cstdio>
 #ifndef NO_THREADS
 #include <boost/thread/shared_lock_guard.hpp>
 #include <boost/thread/lock_guard.hpp>
 #endif
-#include <boost/range/algorithm/copy.hpp>
-#include <boost/range/adaptors.hpp>
 
 
 namespace Tang {
 
+// Parse a bit specifier of the form [!]F<frame>B<bit>
+static bool parse_config_bit(const char *p, const char *end, ConfigBit &b)
+{
+    b.inv = false;
+    if (p != end && *p == '!') {
+        b.inv = true;
+        ++p;
+    }
+    if (p == end || *p++ != 'F')
+        return false;
+    if (!Scanner::parse_uint(p, end, b.frame))
+        return false;
+    if (p == end || *p++ != 'B')
+        return false;
+    if (!Scanner::parse_uint(p, end, b.bit))
+        return false;
+    return p == end;
+}
+
 ConfigBit cbit_from_str(const string &s)
 {
-    size_t idx = 0;
     ConfigBit b;
-    if (s[idx] == '!') {
-        b.inv = true;
-        ++idx;
-    } else {
-        b.inv = false;
-    }
-    assert(s[idx] == 'F');
-    ++idx;
-    size_t b_pos = s.find('B');
-    assert(b_pos != string::npos);
-    b.frame = stoi(s.substr(idx, b_pos - idx));
-    b.bit = stoi(s.substr(b_pos + 1));
+    if (!parse_config_bit(s.data(), s.data() + s.size(), b))
+        throw runtime_error("invalid config bit " + s);
     return b;
 }
 
@@ -42,18 +51,67 @@ BitGroup::BitGroup(const CRAMDelta &delta)
 {
     for (const auto &bit: delta) {
         if (bit.delta != 0)
-            bits.insert(ConfigBit{bit.frame, bit.bit, (bit.delta < 0)});
+            add_bit(ConfigBit{bit.frame, bit.bit, (bit.delta < 0)});
     }
 }
 
+void BitGroup::add_bit(const ConfigBit &bit)
+{
+    mask.reset();
+    // Bits are usually read in order
+    if (bits.empty() || bits.back() < bit) {
+        bits.push_back(bit);
+        return;
+    }
+    auto pos = lower_bound(bits.begin(), bits.end(), bit);
+    if (!(*pos == bit))
+        bits.insert(pos, bit);
+}
+
+void BitGroup::build_mask()
+{
+    // Small groups are held inline and are quicker to test bit by bit
+    if (bits.size() <= inline_bits) {
+        mask.reset();
+        return;
+    }
+    auto packed = make_shared<BitGroupMask>();
+    for (const auto &b : bits) {
+        int word = b.bit / 64;
+        // Sorted bits mean each word is visited once
+        if (packed->words.empty() || packed->words.back().frame != b.frame || packed->words.back().word != word)
+            packed->words.push_back(BitGroupMask::Word{b.frame, word, 0, 0});
+        if (b.inv)
+            packed->words.back().zeros |= (1ULL << (b.bit % 64));
+        else
+            packed->words.back().ones |= (1ULL << (b.bit % 64));
+    }
+    mask = packed;
+}
 
 bool BitGroup::match(const CRAMView &tile) const
 {
     return all_of(bits.begin(), bits.end(), [tile](const ConfigBit &b) {
-        return tile.bit(b.frame, b.bit) != b.inv;
+        return tile.get_bit(b.frame, b.bit) != b.inv;
     });
 }
 
+bool BitGroup::match(const PackedCRAM &tile) const
+{
+    if (!mask) {
+        return all_of(bits.begin(), bits.end(), [&tile](const ConfigBit &b) {
+            return tile.get_bit(b.frame, b.bit) != b.inv;
+        });
+    }
+    for (const auto &w : mask->words) {
+        assert(w.frame < tile.frame_count && w.word < tile.words_per_frame);
+        uint64_t t = tile.words[size_t(w.frame) * tile.words_per_frame + w.word];
+        if ((t & w.ones) != w.ones || (t & w.zeros) != 0)
+            return false;
+    }
+    return true;
+}
+
 void BitGroup::set_group(CRAMView &tile) const
 {
     for (auto bit : bits)
@@ -74,6 +132,19 @@ void BitGroup::add_coverage(Tang::BitSet &known_bits, bool value) const
     }
 }
 
+void BitGroup::add_coverage(PackedCRAM &known_bits, bool value) const
+{
+    if (!mask) {
+        for (const auto &b : bits) {
+            if (b.inv != value)
+                known_bits.words[size_t(b.frame) * known_bits.words_per_frame + b.bit / 64] |= (1ULL << (b.bit % 64));
+        }
+        return;
+    }
+    for (const auto &w : mask->words)
+        known_bits.words[size_t(w.frame) * known_bits.words_per_frame + w.word] |= (value ? w.ones : w.zeros);
+}
+
 ostream &operator<<(ostream &out, const BitGroup &bits)
 {
     bool first = true;
@@ -98,7 +169,7 @@ istream &operator>>(istream &in, BitGroup &bits)
         in >> s;
         if (s == "-")
             break;
-        bits.bits.insert(cbit_from_str(s));
+        bits.add_bit(cbit_from_str(s));
     }
     return in;
 }
@@ -106,30 +177,43 @@ istream &operator>>(istream &in, BitGroup &bits)
 vector<string> MuxBits::get_sources() const
 {
     vector<string> result;
-    boost::copy(arcs | boost::adaptors::map_keys, back_inserter(result));
+    for (const auto &arc : arcs)
+        result.push_back(arc.first.str());
     return result;
 }
 
-boost::optional<string> MuxBits::get_driver(const CRAMView &tile, boost::optional<BitSet &> coverage) const
+// Shared by the CRAMView and PackedCRAM forms of get_driver
+template <typename TileT, typename CoverageT>
+static boost::optional<Symbol> find_driver(const MuxBits &mux, const TileT &tile, CoverageT *coverage)
 {
     boost::optional<const ArcData &> bestmatch;
     size_t bestbits = 0;
-    for (const auto &arc : arcs) {
+    for (const auto &arc : mux.arcs) {
         if (arc.second.bits.match(tile) && arc.second.bits.bits.size() >= bestbits) {
             bestmatch = arc.second;
             bestbits = arc.second.bits.bits.size();
         }
     }
     if (!bestmatch) {
-        return boost::optional<string>();
+        return boost::optional<Symbol>();
     } else {
         if (coverage)
             bestmatch->bits.add_coverage(*coverage);
-        return boost::optional<string>(bestmatch->source);
+        return boost::optional<Symbol>(bestmatch->source);
     }
 }
 
-void MuxBits::set_driver(Tang::CRAMView &tile, const string &driver) const
+boost::optional<Symbol> MuxBits::get_driver(const CRAMView &tile, boost::optional<BitSet &> coverage) const
+{
+    return find_driver(*this, tile, coverage.get_ptr());
+}
+
+boost::optional<Symbol> MuxBits::get_driver(const PackedCRAM &tile, PackedCRAM *coverage) const
+{
+    return find_driver(*this, tile, coverage);
+}
+
+void MuxBits::set_driver(Tang::CRAMView &tile, Symbol driver) const
 {
     auto drv = arcs.find(driver);
     if (drv == arcs.end()) {
@@ -161,22 +245,33 @@ istream &operator>>(istream &in, MuxBits &mux)
     return in;
 }
 
-boost::optional<vector<bool>>
-WordSettingBits::get_value(const CRAMView &tile, boost::optional<BitSet &> coverage) const
+template <typename TileT, typename CoverageT>
+static boost::optional<vector<bool>> find_word_value(const WordSettingBits &ws, const TileT &tile, CoverageT *coverage)
 {
     vector<bool> val;
-    transform(bits.begin(), bits.end(), back_inserter(val), [tile, coverage](const BitGroup &b) {
+    transform(ws.bits.begin(), ws.bits.end(), back_inserter(val), [&tile, coverage](const BitGroup &b) {
         bool m = b.match(tile);
         if (coverage)
             b.add_coverage(*coverage, m);
         return m;
     });
-    if (val == defval)
+    if (val == ws.defval)
         return boost::optional<vector<bool>>();
     else
         return boost::optional<vector<bool>>(val);
 }
 
+boost::optional<vector<bool>>
+WordSettingBits::get_value(const CRAMView &tile, boost::optional<BitSet &> coverage) const
+{
+    return find_word_value(*this, tile, coverage.get_ptr());
+}
+
+boost::optional<vector<bool>> WordSettingBits::get_value(const PackedCRAM &tile, PackedCRAM *coverage) const
+{
+    return find_word_value(*this, tile, coverage);
+}
+
 void WordSettingBits::set_value(Tang::CRAMView &tile, const vector<bool> &value) const
 {
     assert(value.size() == bits.size());
@@ -235,43 +330,66 @@ string EnumSettingBits::get_defval() const
 vector<string> EnumSettingBits::get_options() const
 {
     vector<string> result;
-    boost::copy(options | boost::adaptors::map_keys, back_inserter(result));
+    for (const auto &opt : options)
+        result.push_back(opt.first.str());
     return result;
 }
 
-boost::optional<string> EnumSettingBits::get_value(const CRAMView &tile, boost::optional<BitSet &> coverage) const
+// Special enum value meaning no option is set
+static const Symbol none_value("_NONE_");
+
+// The value of an enum given its best matching option, if any
+template <typename CoverageT>
+static boost::optional<Symbol>
+enum_value_for(const EnumSettingBits &es, const pair<const Symbol, BitGroup> *bestmatch, CoverageT *coverage)
 {
-    boost::optional<const pair<const string, BitGroup> &> bestmatch;
-    size_t bestbits = 0;
-    for (const auto &opt : options) {
-        if (opt.second.match(tile) && opt.second.bits.size() >= bestbits) {
-            bestmatch = opt;
-            bestbits = opt.second.bits.size();
-        }
-    }
     if (!bestmatch) {
-        if (defval) {
-            return boost::optional<string>("_NONE_");
+        if (es.defval) {
+            return boost::optional<Symbol>(none_value);
         } else {
-            return boost::optional<string>();
+            return boost::optional<Symbol>();
         }
     } else {
         if (coverage)
             bestmatch->second.add_coverage(*coverage);
-        if (defval && (options.at(*defval) == bestmatch->second)) {
-            return boost::optional<string>();
+        if (es.defval && (es.options.at(*es.defval) == bestmatch->second)) {
+            return boost::optional<Symbol>();
         } else {
-            return boost::optional<string>(bestmatch->first);
+            return boost::optional<Symbol>(bestmatch->first);
         }
     }
 }
 
-void EnumSettingBits::set_value(Tang::CRAMView &tile, const string &value) const
+template <typename TileT, typename CoverageT>
+static boost::optional<Symbol> find_enum_value(const EnumSettingBits &es, const TileT &tile, CoverageT *coverage)
 {
-    if (value != "_NONE_") {
-        if(options.find(value) != options.end()) {
-            auto grp = options.at(value);
-            grp.set_group(tile);
+    const pair<const Symbol, BitGroup> *bestmatch = nullptr;
+    size_t bestbits = 0;
+    for (const auto &opt : es.options) {
+        if (opt.second.match(tile) && opt.second.bits.size() >= bestbits) {
+            bestmatch = &opt;
+            bestbits = opt.second.bits.size();
+        }
+    }
+    return enum_value_for(es, bestmatch, coverage);
+}
+
+boost::optional<Symbol> EnumSettingBits::get_value(const CRAMView &tile, boost::optional<BitSet &> coverage) const
+{
+    return find_enum_value(*this, tile, coverage.get_ptr());
+}
+
+boost::optional<Symbol> EnumSettingBits::get_value(const PackedCRAM &tile, PackedCRAM *coverage) const
+{
+    return find_enum_value(*this, tile, coverage);
+}
+
+void EnumSettingBits::set_value(Tang::CRAMView &tile, Symbol value) const
+{
+    if (value != none_value) {
+        auto grp = options.find(value);
+        if (grp != options.end()) {
+            grp->second.set_group(tile);
 	}
 	else {
 	    cerr << "EnumSettingBits::set_value: cannot set " << value  << endl;
@@ -301,15 +419,15 @@ istream &operator>>(istream &in, EnumSettingBits &es)
 {
     in >> es.name;
     if (!skip_check_eol(in)) {
-        string s;
+        Symbol s;
         in >> s;
         es.defval = boost::make_optional(s);
     } else {
-        es.defval = boost::optional<string>();
+        es.defval = boost::optional<Symbol>();
     }
     es.options.clear();
     while (!skip_check_eor(in)) {
-        string opt;
+        Symbol opt;
         BitGroup bg;
         in >> opt >> bg;
         es.options[opt] = bg;
@@ -340,13 +458,30 @@ void TileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile,
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    for (auto arc : cfg.carcs)
+    tables->config_to_tile_cram(cfg, tile, is_tilegroup, tg_matches);
+}
+
+TileConfig TileBitDatabase::tile_cram_to_config(const CRAMView &tile) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    return tables->tile_cram_to_config(tile);
+}
+
+void BitDatabaseTables::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile, bool is_tilegroup, set<string> *tg_matches) const
+{
+    PhaseTimer timer(Phase::TILE_ENCODE);
+    Metrics::add(Counter::TILES_ENCODED);
+    if (codec && !is_tilegroup && tile_codecs_enabled() && codec->encode(cfg, tile))
+        return;
+    for (const auto &arc : cfg.carcs)
         muxes.at(arc.sink).set_driver(tile, arc.source);
-    set<string> found_words, found_enums;
+    set<Symbol> found_words, found_enums;
     // Make sure "base" enums like IO type are applied first, other settings may overlay onto them later
     const string base_prefix = "BASE_";
-    for (auto ce : cfg.cenums) {
-        if (ce.name.substr(0, base_prefix.length()) == base_prefix) {
+    for (const auto &ce : cfg.cenums) {
+        if (ce.name.str().compare(0, base_prefix.length(), base_prefix) == 0) {
             if (is_tilegroup && !enums.count(ce.name))
                 continue;
             else if (!enums.count(ce.name))
@@ -359,7 +494,7 @@ void TileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile,
             found_enums.insert(ce.name);
         }
     }
-    for (auto cw : cfg.cwords) {
+    for (const auto &cw : cfg.cwords) {
         if (is_tilegroup && !words.count(cw.name))
             continue;
         if (!words.count(cw.name))
@@ -369,8 +504,8 @@ void TileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile,
         words.at(cw.name).set_value(tile, cw.value);
         found_words.insert(cw.name);
     }
-    for (auto ce : cfg.cenums) {
-        if (ce.name.substr(0, base_prefix.length()) != base_prefix) {
+    for (const auto &ce : cfg.cenums) {
+        if (ce.name.str().compare(0, base_prefix.length(), base_prefix) != 0) {
             if (is_tilegroup && !enums.count(ce.name))
                 continue;
             else if (!enums.count(ce.name))
@@ -388,88 +523,311 @@ void TileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile,
     }
     // Apply default values if not overriden in cfg
     if (!is_tilegroup) {
-        for (auto w : words)
-            if (found_words.find(w.first) == found_words.end())
-                w.second.set_value(tile, w.second.defval);
-        for (auto e : enums)
-            if (found_enums.find(e.first) == found_enums.end())
-                if (e.second.defval)
-                    e.second.set_value(tile, *e.second.defval);
+        for (const auto *w : sorted_words)
+            if (found_words.find(w->name) == found_words.end())
+                w->set_value(tile, w->defval);
+        for (const auto *e : sorted_enums)
+            if (found_enums.find(e->name) == found_enums.end())
+                if (e->defval)
+                    e->set_value(tile, *e->defval);
     }
 
 }
 
-TileConfig TileBitDatabase::tile_cram_to_config(const CRAMView &tile) const
+TileConfig BitDatabaseTables::tile_cram_to_config(const CRAMView &tile) const
 {
-#ifndef NO_THREADS
-    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
+    PhaseTimer timer(Phase::TILE_DECODE);
+    Metrics::add(Counter::TILES_DECODED);
+    // Settings are matched a word at a time against a packed copy of the tile
+    PackedCRAM packed;
+    tile.pack(packed);
+    if (codec && tile_codecs_enabled()) {
+        TileConfig cfg;
+        if (codec->decode(packed, cfg))
+            return cfg;
+    }
+    PackedCRAM coverage;
+    coverage.frame_count = packed.frame_count;
+    coverage.bit_count = packed.bit_count;
+    coverage.words_per_frame = packed.words_per_frame;
+    coverage.words.assign(packed.words.size(), 0);
     TileConfig cfg;
-    BitSet coverage;
-    for (auto mux : muxes) {
-        auto sink = mux.second.get_driver(tile, coverage);
-        if (sink && mux.second.arcs.at(*sink).bits.bits.size() > 0)
-            cfg.carcs.push_back(ConfigArc{mux.first, *sink});
-    }
-    for (auto cw : words) {
-        auto val = cw.second.get_value(tile, coverage);
+    for (size_t i = 0; i < sorted_muxes.size(); i++) {
+        const MuxBits *mux = sorted_muxes[i];
+        const MuxDecision &decision = *sorted_mux_decisions[i];
+        int found = decision.tree.first_match(packed);
+        if (found < 0)
+            continue;
+        const ArcData &arc = *decision.arcs.at(found);
+        arc.bits.add_coverage(coverage);
+        if (arc.bits.bits.size() > 0)
+            cfg.carcs.push_back(ConfigArc{mux->sink, arc.source});
+    }
+    for (const auto *cw : sorted_words) {
+        auto val = cw->get_value(packed, &coverage);
         if (val)
-            cfg.cwords.push_back(ConfigWord{cw.first, *val});
+            cfg.cwords.push_back(ConfigWord{cw->name, *val});
     }
-    for (auto ce : enums) {
-        auto val = ce.second.get_value(tile, coverage);
+    for (size_t i = 0; i < sorted_enums.size(); i++) {
+        const EnumSettingBits *ce = sorted_enums[i];
+        const EnumDecision &decision = *sorted_enum_decisions[i];
+        int found = decision.tree.first_match(packed);
+        auto val = enum_value_for(*ce, (found < 0) ? nullptr : decision.options.at(found), &coverage);
         if (val)
-            cfg.cenums.push_back(ConfigEnum{ce.first, *val});
-    }
-    for (int f = 0; f < tile.frames(); f++) {
-        for (int b = 0; b < tile.bits(); b++) {
-            if (tile.bit(f, b)) {
-                if (coverage.find(ConfigBit{f, b, false}) == coverage.end()) {
-                    cfg.cunknowns.push_back(ConfigUnknown{f, b});
-                } else {
-                    cfg.total_known_bits++;
-                }
-            }
-        }
-    };
+            cfg.cenums.push_back(ConfigEnum{ce->name, *val});
+    }
+    add_unknown_bits(packed, coverage.words.data(), cfg);
     return cfg;
 }
 
+// Read the bits of a BitGroup until end of line, as operator>>(istream, BitGroup)
+static void scan_bitgroup(Scanner &sc, BitGroup &bits, const string &filename)
+{
+    bits.bits.clear();
+    while (!sc.check_eol()) {
+        boost::string_ref tok = sc.token();
+        if (tok == "-")
+            break;
+        ConfigBit b;
+        if (!parse_config_bit(tok.begin(), tok.end(), b))
+            throw runtime_error("invalid config bit " + tok.to_string() + " in database file " + filename);
+        bits.add_bit(b);
+    }
+    bits.build_mask();
+}
+
+// Read the rest of a .mux record into mux, replacing its arcs
+static void scan_mux(Scanner &sc, Symbol sink, MuxBits &mux, const string &filename)
+{
+    mux.sink = sink;
+    mux.arcs.clear();
+    while (!sc.check_eor()) {
+        Symbol source(sc.token());
+        ArcData &arc = mux.arcs[source];
+        arc.source = source;
+        arc.sink = sink;
+        scan_bitgroup(sc, arc.bits, filename);
+    }
+}
+
+// Read the rest of a .config record into cw
+static void scan_word(Scanner &sc, Symbol name, WordSettingBits &cw, const string &filename)
+{
+    cw.name = name;
+    cw.defval.clear();
+    cw.bits.clear();
+    bool have_default = false;
+    if (!sc.check_eol()) {
+        boost::string_ref defval = sc.token();
+        for (auto c = defval.rbegin(); c != defval.rend(); ++c) {
+            assert((*c == '0') || (*c == '1'));
+            cw.defval.push_back(*c == '1');
+        }
+        have_default = true;
+    }
+    while (!sc.check_eor()) {
+        cw.bits.emplace_back();
+        scan_bitgroup(sc, cw.bits.back(), filename);
+    }
+    if (!have_default)
+        cw.defval.resize(cw.bits.size(), false);
+}
+
+// Read the rest of a .config_enum record into ce, replacing its options
+static void scan_enum(Scanner &sc, Symbol name, EnumSettingBits &ce, const string &filename)
+{
+    ce.name = name;
+    ce.options.clear();
+    if (!sc.check_eol())
+        ce.defval = Symbol(sc.token());
+    else
+        ce.defval = boost::optional<Symbol>();
+    while (!sc.check_eor()) {
+        Symbol opt(sc.token());
+        scan_bitgroup(sc, ce.options[opt], filename);
+    }
+}
+
+static void scan_fixed_conn(Scanner &sc, FixedConnection &conn)
+{
+    conn.sink = Symbol(sc.token());
+    conn.source = Symbol(sc.token());
+}
+
 void TileBitDatabase::load()
 {
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    ifstream in(filename);
-    if (!in) {
+    string text;
+    if (!read_file(filename, text)) {
         throw runtime_error("failed to open tilebit database file " + filename);
     }
-    muxes.clear();
-    words.clear();
-    enums.clear();
-    while (!skip_check_eof(in)) {
-        string token;
-        in >> token;
+    tables = make_shared<BitDatabaseTables>();
+    const TileCodec *codec = find_tile_codec(database_hash(text));
+    // Records are built in place in the maps; a repeated record replaces the earlier one
+    Scanner sc(text);
+    while (!sc.check_eof()) {
+        boost::string_ref token = sc.token();
         if (token == ".mux") {
-            MuxBits mux;
-            in >> mux;
-            muxes[mux.sink] = mux;
+            Symbol sink(sc.token());
+            scan_mux(sc, sink, tables->muxes[sink], filename);
         } else if (token == ".config") {
-            WordSettingBits cw;
-            in >> cw;
-            words[cw.name] = cw;
+            Symbol name(sc.token());
+            scan_word(sc, name, tables->words[name], filename);
         } else if (token == ".config_enum") {
-            EnumSettingBits ce;
-            in >> ce;
-            enums[ce.name] = ce;
+            Symbol name(sc.token());
+            scan_enum(sc, name, tables->enums[name], filename);
         } else if (token == ".fixed_conn") {
             FixedConnection c;
-            in >> c;
-            fixed_conns[c.sink].insert(c);
+            scan_fixed_conn(sc, c);
+            tables->fixed_conns[c.sink].insert(c);
+        } else {
+            throw runtime_error("unexpected token " + token.to_string() + " while parsing database file " + filename);
+        }
+    }
+    // Replayed changes keep the sorted lists and trees up to date as they go
+    tables->rebuild();
+    replay_journal();
+    // A codec only matches the database file itself, not any journalled changes
+    if (journal_records == 0)
+        tables->codec = codec;
+}
+
+string TileBitDatabase::journal_filename() const
+{
+    return filename + ".journal";
+}
+
+void TileBitDatabase::replay_journal()
+{
+    journal_records = 0;
+    string text;
+    if (!read_file(journal_filename(), text))
+        return;
+    // Journal records are additions and removals, replayed in order; additions were checked for conflicts when first
+    // applied
+    Scanner sc(text);
+    while (!sc.check_eof()) {
+        boost::string_ref token = sc.token();
+        BitDatabaseBatch batch;
+        if (token == ".remove_word" || token == ".remove_enum" || token == ".remove_fixed") {
+            remove_entry(token.to_string(), Symbol(sc.token()), false);
+            journal_records++;
+            continue;
+        } else if (token == ".mux") {
+            MuxBits mux;
+            scan_mux(sc, Symbol(sc.token()), mux, journal_filename());
+            for (const auto &arc : mux.arcs)
+                batch.arcs.push_back(arc.second);
+        } else if (token == ".config") {
+            batch.words.emplace_back();
+            scan_word(sc, Symbol(sc.token()), batch.words.back(), journal_filename());
+        } else if (token == ".config_enum") {
+            batch.enums.emplace_back();
+            scan_enum(sc, Symbol(sc.token()), batch.enums.back(), journal_filename());
+        } else if (token == ".fixed_conn") {
+            batch.fixed_conns.emplace_back();
+            scan_fixed_conn(sc, batch.fixed_conns.back());
         } else {
-            throw runtime_error("unexpected token " + token + " while parsing database file " + filename);
+            throw runtime_error("unexpected token " + token.to_string() + " while parsing database journal " +
+                                journal_filename());
         }
+        apply_batch(batch, false);
+        journal_records++;
     }
+    // Replaying changes nothing on disk, so only a later change or an explicit save compacts the journal
+}
+
+template <typename T> static void sort_by_name(const map<Symbol, T> &entries, vector<const T *> &sorted)
+{
+    sorted.clear();
+    for (const auto &entry : entries)
+        sorted.push_back(&entry.second);
+    sort(sorted.begin(), sorted.end(), [&](const T *a, const T *b) { return a->name.str() < b->name.str(); });
+}
+
+void BitDatabaseTables::sort_entries()
+{
+    sorted_muxes.clear();
+    for (const auto &mux : muxes)
+        sorted_muxes.push_back(&mux.second);
+    sort(sorted_muxes.begin(), sorted_muxes.end(),
+         [](const MuxBits *a, const MuxBits *b) { return a->sink.str() < b->sink.str(); });
+    sort_by_name(words, sorted_words);
+    sort_by_name(enums, sorted_enums);
+    // Decisions are map entries, so these stay valid when other entries are added or recompiled
+    sorted_mux_decisions.clear();
+    for (const auto *mux : sorted_muxes)
+        sorted_mux_decisions.push_back(&mux_decisions.at(mux->sink));
+    sorted_enum_decisions.clear();
+    for (const auto *senum : sorted_enums)
+        sorted_enum_decisions.push_back(&enum_decisions.at(senum->name));
+}
+
+// Order candidates as best-match selection prefers them: most bits first, then later in name order first
+template <typename T, typename BitsFn> static void sort_by_preference(vector<const T *> &candidates, BitsFn bits)
+{
+    reverse(candidates.begin(), candidates.end());
+    stable_sort(candidates.begin(), candidates.end(), [bits](const T *a, const T *b) {
+        return bits(*a).bits.size() > bits(*b).bits.size();
+    });
+}
+
+void BitDatabaseTables::compile_mux(Symbol sink)
+{
+    MuxDecision &decision = mux_decisions[sink];
+    decision.arcs.clear();
+    for (const auto &arc : muxes.at(sink).arcs)
+        decision.arcs.push_back(&arc.second);
+    sort_by_preference(decision.arcs, [](const ArcData &arc) -> const BitGroup & { return arc.bits; });
+    vector<const BitGroup *> groups;
+    for (const auto *arc : decision.arcs)
+        groups.push_back(&arc->bits);
+    decision.tree = DecisionTree(groups);
+}
+
+void BitDatabaseTables::compile_enum(Symbol name)
+{
+    EnumDecision &decision = enum_decisions[name];
+    decision.options.clear();
+    for (const auto &opt : enums.at(name).options)
+        decision.options.push_back(&opt);
+    sort_by_preference(decision.options,
+                       [](const pair<const Symbol, BitGroup> &opt) -> const BitGroup & { return opt.second; });
+    vector<const BitGroup *> groups;
+    for (const auto *opt : decision.options)
+        groups.push_back(&opt->second);
+    decision.tree = DecisionTree(groups);
+}
+
+void BitDatabaseTables::rebuild()
+{
+    mux_decisions.clear();
+    enum_decisions.clear();
+    for (const auto &mux : muxes)
+        compile_mux(mux.first);
+    for (const auto &senum : enums)
+        compile_enum(senum.first);
+    sort_entries();
+}
+
+BitDatabaseTables::BitDatabaseTables(const BitDatabaseTables &other)
+        : muxes(other.muxes), words(other.words), enums(other.enums), fixed_conns(other.fixed_conns)
+{
+    rebuild();
+}
+
+vector<FixedConnection> BitDatabaseTables::sorted_fixed_conns() const
+{
+    vector<Symbol> sinks;
+    for (const auto &conns : fixed_conns)
+        sinks.push_back(conns.first);
+    sort(sinks.begin(), sinks.end(), SymbolNameLess());
+    vector<FixedConnection> result;
+    for (Symbol sink : sinks)
+        result.insert(result.end(), fixed_conns.at(sink).begin(), fixed_conns.at(sink).end());
+    return result;
 }
 
 void TileBitDatabase::save()
@@ -477,22 +835,42 @@ void TileBitDatabase::save()
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    ofstream out(filename);
-    if (!out) {
-        throw runtime_error("failed to open tilebit database file " + filename + " for writing");
-    }
-    out << "# Routing Mux Bits" << endl;
-    for (auto mux : muxes)
-        out << mux.second << endl;
-    out << endl << "# Non-Routing Configuration" << endl;
-    for (auto word : words)
-        out << word.second << endl;
-    for (auto senum : enums)
-        out << senum.second << endl;
-    out << endl << "# Fixed Connections" << endl;
-    for (auto conns : fixed_conns)
-        for (auto conn2 : conns.second)
-            out << conn2 << endl;
+    write_database();
+}
+
+void TileBitDatabase::write_database()
+{
+    // Write to a temporary file and rename it over the database, so that a failed save leaves the database and
+    // journal as they were
+    string temp_filename = filename + ".new";
+    {
+        ofstream out(temp_filename);
+        if (!out) {
+            throw runtime_error("failed to open tilebit database file " + temp_filename + " for writing");
+        }
+        out << "# Routing Mux Bits" << endl;
+        for (const auto *mux : tables->sorted_muxes)
+            out << *mux << endl;
+        out << endl << "# Non-Routing Configuration" << endl;
+        for (const auto *word : tables->sorted_words)
+            out << *word << endl;
+        for (const auto *senum : tables->sorted_enums)
+            out << *senum << endl;
+        out << endl << "# Fixed Connections" << endl;
+        for (const auto &conn : tables->sorted_fixed_conns())
+            out << conn << endl;
+        if (!out) {
+            throw runtime_error("failed to write tilebit database file " + temp_filename);
+        }
+    }
+    // rename does not replace an existing file on every platform
+    if (rename(temp_filename.c_str(), filename.c_str()) != 0 &&
+        (remove(filename.c_str()) != 0 || rename(temp_filename.c_str(), filename.c_str()) != 0)) {
+        throw runtime_error("failed to replace tilebit database file " + filename);
+    }
+    // The journal is now part of the database
+    remove(journal_filename().c_str());
+    journal_records = 0;
     dirty = false;
 }
 
@@ -502,16 +880,17 @@ vector<string> TileBitDatabase::get_sinks() const
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
     vector<string> result;
-    boost::copy(muxes | boost::adaptors::map_keys, back_inserter(result));
+    for (const auto *mux : tables->sorted_muxes)
+        result.push_back(mux->sink.str());
     return result;
 }
 
-MuxBits TileBitDatabase::get_mux_data_for_sink(const string &sink) const
+MuxBits TileBitDatabase::get_mux_data_for_sink(Symbol sink) const
 {
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    return muxes.at(sink);
+    return tables->muxes.at(sink);
 }
 
 vector<string> TileBitDatabase::get_settings_words() const
@@ -520,16 +899,17 @@ vector<string> TileBitDatabase::get_settings_words() const
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
     vector<string> result;
-    boost::copy(words | boost::adaptors::map_keys, back_inserter(result));
+    for (const auto *word : tables->sorted_words)
+        result.push_back(word->name.str());
     return result;
 }
 
-WordSettingBits TileBitDatabase::get_data_for_setword(const string &name) const
+WordSettingBits TileBitDatabase::get_data_for_setword(Symbol name) const
 {
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    return words.at(name);
+    return tables->words.at(name);
 }
 
 vector<string> TileBitDatabase::get_settings_enums() const
@@ -538,16 +918,17 @@ vector<string> TileBitDatabase::get_settings_enums() const
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
     vector<string> result;
-    boost::copy(enums | boost::adaptors::map_keys, back_inserter(result));
+    for (const auto *senum : tables->sorted_enums)
+        result.push_back(senum->name.str());
     return result;
 }
 
-EnumSettingBits TileBitDatabase::get_data_for_enum(const string &name) const
+EnumSettingBits TileBitDatabase::get_data_for_enum(Symbol name) const
 {
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    return enums.at(name);
+    return tables->enums.at(name);
 }
 
 vector<FixedConnection> TileBitDatabase::get_fixed_conns() const
@@ -555,32 +936,32 @@ vector<FixedConnection> TileBitDatabase::get_fixed_conns() const
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    vector<FixedConnection> result;
-    for (const auto &csink : fixed_conns) {
-        for (const auto &conn : csink.second) {
-            result.push_back(conn);
-        }
-    }
-    return result;
+    return tables->sorted_fixed_conns();
 }
 
-vector<pair<string, bool>> TileBitDatabase::get_downhill_wires(const string &wire) const
+vector<pair<string, bool>> BitDatabaseTables::get_downhill_wires(Symbol wire) const
 {
     vector<pair<string, bool>> dhwires;
-    for (const auto &mux : muxes) {
-        for (const auto &arc : mux.second.arcs) {
+    for (const auto *mux : sorted_muxes) {
+        for (const auto &arc : mux->arcs) {
             if (arc.second.source == wire)
-                dhwires.push_back(make_pair(arc.second.sink, true));
+                dhwires.push_back(make_pair(arc.second.sink.str(), true));
         }
     }
-    for (const auto &csink : fixed_conns) {
-        for (const auto &conn : csink.second) {
-            if (conn.source == wire)
-                dhwires.push_back(make_pair(conn.sink, false));
-        }
+    for (const auto &conn : sorted_fixed_conns()) {
+        if (conn.source == wire)
+            dhwires.push_back(make_pair(conn.sink.str(), false));
     }
     return dhwires;
 }
+
+vector<pair<string, bool>> TileBitDatabase::get_downhill_wires(Symbol wire) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    return tables->get_downhill_wires(wire);
+}
 /*
 void TileBitDatabase::add_routing(const TileInfo &tile, RoutingGraph &graph) const
 {
@@ -590,7 +971,7 @@ void TileBitDatabase::add_routing(const TileInfo &tile, RoutingGraph &graph) con
     int row, col;
     tie(row, col) = tile.get_row_col();
     Location loc(col, row);
-    for (const auto &mux : muxes) {
+    for (const auto &mux : tables->muxes) {
         RoutingId sink = graph.globalise_net(row, col, mux.second.sink);
         if (sink == RoutingId())
             continue;
@@ -608,7 +989,7 @@ void TileBitDatabase::add_routing(const TileInfo &tile, RoutingGraph &graph) con
         }
     }
 
-    for (const auto &fcs : fixed_conns) {
+    for (const auto &fcs : tables->fixed_conns) {
         for (const auto &fc : fcs.second) {
             RoutingId sink = graph.globalise_net(row, col, fc.sink);
             if (sink == RoutingId())
@@ -627,93 +1008,241 @@ void TileBitDatabase::add_routing(const TileInfo &tile, RoutingGraph &graph) con
     }
 }
 */
+bool BitDatabaseBatch::empty() const
+{
+    return arcs.empty() && words.empty() && enums.empty() && fixed_conns.empty();
+}
+
 void TileBitDatabase::add_mux_arc(const ArcData &arc)
+{
+    BitDatabaseBatch batch;
+    batch.arcs.push_back(arc);
+    apply(batch);
+}
+
+void TileBitDatabase::add_setting_word(const WordSettingBits &wsb)
+{
+    BitDatabaseBatch batch;
+    batch.words.push_back(wsb);
+    apply(batch);
+}
+
+void TileBitDatabase::add_setting_enum(const EnumSettingBits &esb)
+{
+    BitDatabaseBatch batch;
+    batch.enums.push_back(esb);
+    apply(batch);
+}
+
+void TileBitDatabase::add_fixed_conn(const Tang::FixedConnection &conn)
+{
+    BitDatabaseBatch batch;
+    batch.fixed_conns.push_back(conn);
+    apply(batch);
+}
+
+void TileBitDatabase::apply(const BitDatabaseBatch &batch)
 {
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    dirty = true;
-    if (muxes.find(arc.sink) == muxes.end()) {
-        MuxBits mux;
-        mux.sink = arc.sink;
-        muxes[mux.sink] = mux;
-    }
-    MuxBits &curr = muxes.at(arc.sink);
-    auto found = curr.arcs.find(arc.source);
-    if (found == curr.arcs.end()) {
-        curr.arcs[arc.source] = arc;
-    } else {
-        if (found->second.bits == arc.bits) {
-            // In DB already, no-op
+    check_batch(batch);
+    apply_batch(batch, true);
+}
+
+void TileBitDatabase::check_batch(const BitDatabaseBatch &batch) const
+{
+    // Entries added earlier in the batch, which later entries are checked against as if already in the database
+    map<pair<Symbol, Symbol>, const BitGroup *> staged_arcs;
+    for (const auto &arc : batch.arcs) {
+        const BitGroup *existing = nullptr;
+        auto staged = staged_arcs.find(make_pair(arc.sink, arc.source));
+        if (staged != staged_arcs.end()) {
+            existing = staged->second;
         } else {
+            auto mux = tables->muxes.find(arc.sink);
+            if (mux != tables->muxes.end()) {
+                auto found = mux->second.arcs.find(arc.source);
+                if (found != mux->second.arcs.end())
+                    existing = &found->second.bits;
+            }
+        }
+        if (existing == nullptr) {
+            staged_arcs[make_pair(arc.sink, arc.source)] = &arc.bits;
+        } else if (!(*existing == arc.bits)) {
             throw DatabaseConflictError(fmt("database conflict: arc " << arc.source << " -> " << arc.sink <<
                                                                       " already in DB, but config bits " <<
                                                                       arc.bits
                                                                       << " don't match existing DB bits " <<
-                                                                      found->second.bits));
+                                                                      *existing));
         }
     }
 
-}
-
-void TileBitDatabase::add_setting_word(const WordSettingBits &wsb)
-{
-#ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
-    dirty = true;
-    if (words.find(wsb.name) != words.end()) {
-        WordSettingBits &curr = words.at(wsb.name);
-        if (curr.bits.size() != wsb.bits.size()) {
-            throw DatabaseConflictError(fmt("word " << curr.name << " already exists in DB, but new size "
+    map<Symbol, const WordSettingBits *> staged_words;
+    for (const auto &wsb : batch.words) {
+        const WordSettingBits *curr = nullptr;
+        auto staged = staged_words.find(wsb.name);
+        if (staged != staged_words.end()) {
+            curr = staged->second;
+        } else if (tables->words.find(wsb.name) != tables->words.end()) {
+            curr = &tables->words.at(wsb.name);
+        }
+        if (curr == nullptr) {
+            staged_words[wsb.name] = &wsb;
+            continue;
+        }
+        if (curr->bits.size() != wsb.bits.size()) {
+            throw DatabaseConflictError(fmt("word " << curr->name << " already exists in DB, but new size "
                                                     << wsb.bits.size() << " does not match existing size "
-                                                    << curr.bits.size()));
+                                                    << curr->bits.size()));
         }
-        for (size_t i = 0; i < curr.bits.size(); i++) {
-            if (!(curr.bits.at(i) == wsb.bits.at(i))) {
+        for (size_t i = 0; i < curr->bits.size(); i++) {
+            if (!(curr->bits.at(i) == wsb.bits.at(i))) {
                 throw DatabaseConflictError(fmt("bit " << wsb.name << "[" << i << "] already in DB, but config bits "
                                                        << wsb.bits.at(i) << " don't match existing DB bits "
-                                                       << curr.bits.at(i)));
+                                                       << curr->bits.at(i)));
             }
         }
-    } else {
-        words[wsb.name] = wsb;
     }
-}
 
-void TileBitDatabase::add_setting_enum(const EnumSettingBits &esb)
-{
-#ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
-    dirty = true;
-    if (enums.find(esb.name) != enums.end()) {
-        EnumSettingBits &curr = enums.at(esb.name);
-        for (const auto &opt : esb.options) {
-            if (curr.options.find(opt.first) == curr.options.end()) {
-                curr.options[opt.first] = opt.second;
-            } else {
-                if (curr.options.at(opt.first) == opt.second) {
-                    // No-op
-                } else {
+    // An added enum replaces the existing one, so each is checked against the latest version
+    map<Symbol, const EnumSettingBits *> staged_enums;
+    for (const auto &esb : batch.enums) {
+        const EnumSettingBits *curr = nullptr;
+        auto staged = staged_enums.find(esb.name);
+        if (staged != staged_enums.end()) {
+            curr = staged->second;
+        } else if (tables->enums.find(esb.name) != tables->enums.end()) {
+            curr = &tables->enums.at(esb.name);
+        }
+        if (curr != nullptr) {
+            for (const auto &opt : esb.options) {
+                auto found = curr->options.find(opt.first);
+                if (found != curr->options.end() && !(found->second == opt.second)) {
                     throw DatabaseConflictError(
                             fmt("option " << opt.first << " of " << esb.name << " already in DB, but config bits "
                                           << opt.second << " don't match existing DB bits "
-                                          << curr.options.at(opt.first)));
+                                          << found->second));
                 }
             }
         }
+        staged_enums[esb.name] = &esb;
     }
-    enums[esb.name] = esb;
 }
 
-void TileBitDatabase::add_fixed_conn(const Tang::FixedConnection &conn)
+// Journal records are compacted into the database file once there are this many
+static const size_t journal_compact_records = 4096;
+
+void TileBitDatabase::apply_batch(const BitDatabaseBatch &batch, bool write_journal)
+{
+    // The tables are only copied, and the codec dropped, once the batch is found to change something
+    bool writable = false;
+    auto make_writable = [&]() {
+        if (!writable)
+            make_tables_writable();
+        writable = true;
+    };
+    // Only additions that change the database are journalled
+    ostringstream journal;
+    size_t records = 0;
+    bool new_entries = false;
+    set<Symbol> changed_muxes;
+    for (const auto &arc : batch.arcs) {
+        auto found = tables->muxes.find(arc.sink);
+        if (found != tables->muxes.end() && found->second.arcs.count(arc.source))
+            continue;
+        make_writable();
+        if (tables->muxes.find(arc.sink) == tables->muxes.end()) {
+            MuxBits mux;
+            mux.sink = arc.sink;
+            tables->muxes[mux.sink] = mux;
+            new_entries = true;
+        }
+        ArcData &added = tables->muxes.at(arc.sink).arcs[arc.source];
+        added = arc;
+        added.bits.build_mask();
+        changed_muxes.insert(arc.sink);
+        journal << ".mux " << arc.sink << endl << arc.source << " " << arc.bits << endl << endl;
+        records++;
+    }
+    for (Symbol sink : changed_muxes)
+        tables->compile_mux(sink);
+    for (const auto &wsb : batch.words) {
+        if (tables->words.find(wsb.name) == tables->words.end()) {
+            make_writable();
+            WordSettingBits &added = tables->words[wsb.name];
+            added = wsb;
+            for (auto &bits : added.bits)
+                bits.build_mask();
+            journal << wsb << endl;
+            records++;
+            new_entries = true;
+        }
+    }
+    for (const auto &esb : batch.enums) {
+        auto found = tables->enums.find(esb.name);
+        if (found == tables->enums.end()) {
+            new_entries = true;
+        } else if (found->second == esb) {
+            continue;
+        }
+        make_writable();
+        EnumSettingBits &added = tables->enums[esb.name];
+        added = esb;
+        for (auto &opt : added.options)
+            opt.second.build_mask();
+        tables->compile_enum(esb.name);
+        journal << esb << endl;
+        records++;
+    }
+    for (const auto &conn : batch.fixed_conns) {
+        auto found = tables->fixed_conns.find(conn.sink);
+        if (found == tables->fixed_conns.end() || !found->second.count(conn)) {
+            make_writable();
+            tables->fixed_conns[conn.sink].insert(conn);
+            journal << conn;
+            records++;
+        }
+    }
+    if (new_entries)
+        tables->sort_entries();
+    if (records == 0 || !write_journal)
+        return;
+    write_journal_records(journal.str(), records);
+}
+
+void TileBitDatabase::write_journal_records(const string &text, size_t records)
 {
-#ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
-    fixed_conns[conn.sink].insert(conn);
     dirty = true;
+    {
+        ofstream out(journal_filename(), ios::app);
+        if (!out) {
+            throw runtime_error("failed to open tilebit database journal " + journal_filename() + " for writing");
+        }
+        out << text;
+    }
+    journal_records += records;
+    if (journal_records >= journal_compact_records)
+        write_database();
+}
+
+void TileBitDatabase::remove_entry(const string &record, Symbol name, bool write_journal)
+{
+    bool fixed = (record == ".remove_fixed"), senum = (record == ".remove_enum");
+    if (fixed ? !tables->fixed_conns.count(name) : senum ? !tables->enums.count(name) : !tables->words.count(name))
+        return;
+    make_tables_writable();
+    if (fixed) {
+        tables->fixed_conns.erase(name);
+    } else if (senum) {
+        tables->enums.erase(name);
+        tables->enum_decisions.erase(name);
+    } else {
+        tables->words.erase(name);
+    }
+    tables->sort_entries();
+    if (write_journal)
+        write_journal_records(record + " " + name.str() + "\n\n", 1);
 }
 
 TileBitDatabase::TileBitDatabase(const TileBitDatabase &other)
@@ -723,28 +1252,103 @@ TileBitDatabase::TileBitDatabase(const TileBitDatabase &other)
     terminate();
 }
 
-void TileBitDatabase::remove_fixed_sink(const string &sink)
+void TileBitDatabase::remove_fixed_sink(Symbol sink)
 {
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    fixed_conns.erase(sink);
+    remove_entry(".remove_fixed", sink, true);
 }
 
-void TileBitDatabase::remove_setting_enum(const string &enum_name)
+void TileBitDatabase::remove_setting_enum(Symbol enum_name)
 {
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    enums.erase(enum_name);
+    remove_entry(".remove_enum", enum_name, true);
 }
 
-void TileBitDatabase::remove_setting_word(const string &word_name)
+void TileBitDatabase::remove_setting_word(Symbol word_name)
 {
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    words.erase(word_name);
+    remove_entry(".remove_word", word_name, true);
+}
+
+void TileBitDatabase::make_tables_writable()
+{
+    if (tables.use_count() > 1)
+        tables = make_shared<BitDatabaseTables>(*tables);
+    tables->codec = nullptr;
+}
+
+shared_ptr<const FrozenTileBitDatabase> TileBitDatabase::freeze() const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    return shared_ptr<const FrozenTileBitDatabase>(new FrozenTileBitDatabase(tables));
+}
+
+FrozenTileBitDatabase::FrozenTileBitDatabase(shared_ptr<const BitDatabaseTables> tables)
+        : tables(tables), fixed_conns(tables->sorted_fixed_conns())
+{}
+
+void FrozenTileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile, bool is_tilegroup,
+                                                set<string> *tg_matches) const
+{
+    tables->config_to_tile_cram(cfg, tile, is_tilegroup, tg_matches);
+}
+
+TileConfig FrozenTileBitDatabase::tile_cram_to_config(const CRAMView &tile) const
+{
+    return tables->tile_cram_to_config(tile);
+}
+
+const vector<const MuxBits *> &FrozenTileBitDatabase::get_muxes() const
+{
+    return tables->sorted_muxes;
+}
+
+const vector<const WordSettingBits *> &FrozenTileBitDatabase::get_words() const
+{
+    return tables->sorted_words;
+}
+
+const vector<const EnumSettingBits *> &FrozenTileBitDatabase::get_enums() const
+{
+    return tables->sorted_enums;
+}
+
+const vector<FixedConnection> &FrozenTileBitDatabase::get_fixed_conns() const
+{
+    return fixed_conns;
+}
+
+const MuxBits &FrozenTileBitDatabase::get_mux_data_for_sink(Symbol sink) const
+{
+    return tables->muxes.at(sink);
+}
+
+const WordSettingBits &FrozenTileBitDatabase::get_data_for_setword(Symbol name) const
+{
+    return tables->words.at(name);
+}
+
+const EnumSettingBits &FrozenTileBitDatabase::get_data_for_enum(Symbol name) const
+{
+    return tables->enums.at(name);
+}
+
+vector<pair<string, bool>> FrozenTileBitDatabase::get_downhill_wires(Symbol wire) const
+{
+    return tables->get_downhill_wires(wire);
+}
+
+const TileCodec *FrozenTileBitDatabase::get_codec() const
+{
+    return tables->codec;
 }
 
 DatabaseConflictError::DatabaseConflictError(const string &desc) : runtime_error(desc)
@@ -752,8 +1356,15 @@ DatabaseConflictError::DatabaseConflictError(const string &desc) : runtime_error
 
 TileBitDatabase::~TileBitDatabase()
 {
-    if (dirty)
-        save();
+    // Changes are already safe in the journal, so a database that cannot be written (e.g. installed read-only) is
+    // left to be compacted by a later save
+    if (dirty) {
+        try {
+            save();
+        } catch (runtime_error &e) {
+            cerr << "warning: " << e.what() << endl;
+        }
+    }
 }
 
 }
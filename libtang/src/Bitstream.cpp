@@ -1,11 +1,20 @@
 #include "Bitstream.hpp"
 #include "Chip.hpp"
 #include "Util.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+#include <array>
 #include <bitset>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/optional.hpp>
 #include <cstring>
 #include <iostream>
+#ifndef NO_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
 
 namespace Tang {
 
@@ -38,25 +47,29 @@ enum class BitstreamCommand : uint8_t {
     CPLD_DATA = 0xaa,
 };
 
+// Shifting a byte into the CRC a bit at a time is the same as shifting it in whole and folding the byte shifted out
+// back in, which only depends on that byte
+static array<uint16_t, 256> make_crc16_table()
+{
+    array<uint16_t, 256> table;
+    for (int top = 0; top < 256; top++) {
+        uint16_t crc = uint16_t(top << 8);
+        for (int i = 0; i < 8; i++)
+            crc = uint16_t((crc << 1) ^ ((crc & 0x8000) ? CRC16_POLY : 0));
+        table[top] = crc;
+    }
+    return table;
+}
+
+static const array<uint16_t, 256> crc16_table = make_crc16_table();
+
 class Crc16 {
 public:
     uint16_t crc16 = CRC16_INIT;
 
     // Add a single byte to the running CRC16 accumulator
     void update_crc16(uint8_t val) {
-        int bit_flag;
-        for (int i = 7; i >= 0; i--) {
-            bit_flag = crc16 >> 15;
-
-            /* Get next bit: */
-            crc16 <<= 1;
-            crc16 |= (val >> i) & 1; // item a) work from the least significant bits
-
-            /* Cycle check: */
-            if (bit_flag)
-                crc16 ^= CRC16_POLY;
-        }
-
+        crc16 = uint16_t(((crc16 << 8) | val) ^ crc16_table[crc16 >> 8]);
     }
 
     uint16_t finalise_crc16() {
@@ -234,7 +247,12 @@ public:
 
     void read_block() {
         std::vector<uint8_t> block;
+        // A truncated file is reported rather than read past its end
+        if (data.end() - iter < 2)
+            throw BitstreamParseError("Bitstream ends inside a block size", get_offset());
         uint16_t block_size = get_block_size();
+        if (data.end() - iter < block_size)
+            throw BitstreamParseError("Bitstream ends inside a block", get_offset());
         get_vector(block, block_size);
         blocks.push_back(block);
     }
@@ -354,6 +372,7 @@ private:
 Bitstream::Bitstream(const std::vector<uint8_t> &data, const std::vector<std::string> &metadata)
         : data(data), metadata(metadata)
 {
+    PhaseTimer timer(Phase::BLOCK_PARSE);
     BitstreamReadWriter rd(data);
     while (!rd.is_end()) {
         rd.read_block();
@@ -389,6 +408,7 @@ Bitstream Bitstream::read(std::istream &in)
     in.seekg(start_pos, in.beg);
     bytes.resize(length);
     in.read(reinterpret_cast<char *>(&(bytes[0])), length);
+    Metrics::add(Counter::BYTES_READ, start_pos + length);
     return Bitstream(bytes, meta);
 }
 
@@ -399,8 +419,25 @@ Bitstream Bitstream::read(std::istream &in)
 
 static const vector<uint8_t> preamble = {0xCC, 0x55, 0xAA, 0x33};
 
+// Only nonzero bytes need unpacking, which makes sparse designs cheap
+void Bitstream::unpack_frame(Chip &chip, int frame, const uint8_t *bytes, size_t count)
+{
+    vector<char> &row = chip.cram.data->at(frame);
+    assert(row.size() >= count * 8);
+    fill(row.begin(), row.end(), 0);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t byte = bytes[i];
+        if (byte == 0)
+            continue;
+        chip.occupancy.mark(frame, int(i / 8));
+        for (int j = 0; j < 8; j++)
+            row[i * 8 + j] = (char) ((byte << j) & 0x80);
+    }
+}
+
 Chip Bitstream::deserialise_chip()
 {
+    PhaseTimer timer(Phase::BLOCK_PARSE);
     boost::optional<Chip> chip;
 
     Crc16 data_crc16;
@@ -536,17 +573,20 @@ Chip Bitstream::deserialise_chip()
                 uint16_t frames = rd.get_uint16();
                 uint16_t bytes_per_frame = chip->info.bits_per_frame / 8L;
                 unique_ptr<uint8_t[]> frame_bytes = make_unique<uint8_t[]>(bytes_per_frame);
+                chip->occupancy = CRAMOccupancy(chip->cram.frames(), chip->cram.bits());
                 // taking current CRC16
                 data_crc16.crc16 = rd.crc16.crc16;
                 for (int idx = 0; idx < frames; idx++) {
                     it++;
                     BlockReadWriter rd(*it);
                     rd.get_bytes(frame_bytes.get(), bytes_per_frame);
+                    PhaseTimer crc_timer(Phase::CRC);
                     // Update CRC16 for complete frame
                     for (size_t i = 0; i < bytes_per_frame; i++) {
                         data_crc16.update_crc16(frame_bytes[i]);
                     }
                     uint16_t actual_crc = data_crc16.finalise_crc16();
+                    crc_timer.stop();
                     uint16_t exp_crc = rd.get_uint16(); // crc 
                     if (actual_crc != exp_crc) {
                         ostringstream err;
@@ -556,11 +596,13 @@ Chip Bitstream::deserialise_chip()
                                       
                     if (rd.get_uint32()) 
                         throw BitstreamParseError("error parsing fuse data");
-                    for (uint32_t j = 0; j < chip->info.bits_per_frame; j++) {
-                        chip->cram.bit(idx, j) = (char) ((frame_bytes[(j / 8)]<< (j % 8)) & 0x80);
-                    }
+                    PhaseTimer unpack_timer(Phase::UNPACK);
+                    unpack_frame(*chip, idx, frame_bytes.get(), bytes_per_frame);
+                    unpack_timer.stop();
                     data_crc16.reset_crc16();    
                 }
+                chip->occupancy.finalise(chip->cram);
+                Metrics::add(Counter::FRAMES_READ, frames);
                 // zero block, just skip
                 it++;
                 break;
@@ -582,10 +624,12 @@ Chip Bitstream::deserialise_chip()
                 else
                     chip->bram_data[bram_block_id].resize(bram_bytes_per_frame);
                 rd.get_bytes(frame_bytes.get(), bram_bytes_per_frame);
+                PhaseTimer crc_timer(Phase::CRC);
                 // Update CRC16 for complete frame
                 for (size_t i = 0; i < bram_bytes_per_frame; i++) {
                     data_crc16.update_crc16(frame_bytes[i]);
                 }
+                crc_timer.stop();
                 if (type == 0x0001) {
                     for(size_t i=0;i<bram_bytes_per_frame;i++)
                         chip->pll_data[pll_index][i] = frame_bytes[i];
@@ -629,17 +673,20 @@ Chip Bitstream::deserialise_chip()
                 uint16_t frames = cmd_size;
                 uint16_t bytes_per_frame = chip->info.bits_per_frame / 8L;
                 unique_ptr<uint8_t[]> frame_bytes = make_unique<uint8_t[]>(bytes_per_frame);
+                chip->occupancy = CRAMOccupancy(chip->cram.frames(), chip->cram.bits());
                 // taking current CRC16
                 data_crc16.crc16 = rd.crc16.crc16;
                 for (int idx = 0; idx < frames; idx++) {
                     it++;
                     BlockReadWriter rd(*it);
                     rd.get_bytes(frame_bytes.get(), bytes_per_frame);
+                    PhaseTimer crc_timer(Phase::CRC);
                     // Update CRC16 for complete frame
                     for (size_t i = 0; i < bytes_per_frame; i++) {
                         data_crc16.update_crc16(frame_bytes[i]);
                     }
                     uint16_t actual_crc = data_crc16.finalise_crc16();
+                    crc_timer.stop();
                     uint16_t exp_crc = rd.get_uint16(); // crc 
                     if (actual_crc != exp_crc) {
                         ostringstream err;
@@ -648,11 +695,13 @@ Chip Bitstream::deserialise_chip()
                         throw BitstreamParseError(err.str());
                     }
                                       
-                    for (uint32_t j = 0; j < chip->info.bits_per_frame; j++) {
-                        chip->cram.bit(idx, j) = (char) ((frame_bytes[(j / 8)]<< (j % 8)) & 0x80);
-                    }
+                    PhaseTimer unpack_timer(Phase::UNPACK);
+                    unpack_frame(*chip, idx, frame_bytes.get(), bytes_per_frame);
+                    unpack_timer.stop();
                     data_crc16.reset_crc16();    
                 }
+                chip->occupancy.finalise(chip->cram);
+                Metrics::add(Counter::FRAMES_READ, frames);
                 break;
             }
 
@@ -677,22 +726,32 @@ Chip Bitstream::deserialise_chip()
 
 void Bitstream::write_bit(std::ostream &out)
 {
+    PhaseTimer timer(Phase::WRITE);
     for (const auto &str : metadata) {
         out << str;
         out.put(0x0a);
     }
     // Dump raw bitstream
     out.write(reinterpret_cast<const char *>(&(data[0])), data.size());
+    if (Metrics::enabled()) {
+        size_t bytes = data.size();
+        for (const auto &str : metadata)
+            bytes += str.size() + 1;
+        Metrics::add(Counter::BYTES_WRITTEN, bytes);
+    }
 }
 
 void Bitstream::write_bin(std::ostream &out)
 {
+    PhaseTimer timer(Phase::WRITE);
     for (auto &block : blocks) {
         out.write(reinterpret_cast<const char *>(&(block[0])), block.size());
+        Metrics::add(Counter::BYTES_WRITTEN, block.size());
     }
 }
 
 void Bitstream::write_bas(std::ostream &out) {
+    PhaseTimer timer(Phase::WRITE);
     for (const auto &meta : metadata) {
         out << meta << std::endl;
     }
@@ -705,6 +764,7 @@ void Bitstream::write_bas(std::ostream &out) {
 }
 
 void Bitstream::write_bmk(const Chip &chip, std::ostream &out) {
+    PhaseTimer timer(Phase::WRITE);
     for (const auto &meta : metadata) {
         if (boost::starts_with(meta, "# Bitstream CRC:"))
             continue;
@@ -734,6 +794,7 @@ void Bitstream::write_bmk(const Chip &chip, std::ostream &out) {
 }
 
 void Bitstream::write_bma(const Chip &chip, std::ostream &out) {
+    PhaseTimer timer(Phase::WRITE);
     for (const auto &meta : metadata) {
         if (boost::starts_with(meta, "# Bitstream CRC:"))
             continue;
@@ -771,7 +832,9 @@ static uint8_t reverse_byte(uint8_t byte)
 
 void Bitstream::write_rbf(std::ostream &out)
 {
+    PhaseTimer timer(Phase::WRITE);
     for (auto &block : blocks) {
+        Metrics::add(Counter::BYTES_WRITTEN, block.size());
         for(auto byte : block) {
             uint8_t val = reverse_byte(byte);
             out.write(reinterpret_cast<const char *>(&val), 1);
@@ -779,6 +842,7 @@ void Bitstream::write_rbf(std::ostream &out)
     }
 }
 void Bitstream::write_svf(const Chip &chip, std::ostream &out) {
+    PhaseTimer timer(Phase::WRITE);
     out << "// Created using Project Tang Software" << std::endl;
     out << "// Architecture: " << chip.info.name << std::endl;
     //out << "// Package: " << chip.info << std::endl;
@@ -876,8 +940,9 @@ void Bitstream::write_svf(const Chip &chip, std::ostream &out) {
     out << "SIR 8 TDI (1f) ;" << std::endl;
 }
 
-Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string>) {
-    BitstreamReadWriter wr;
+// Write everything before the configuration frames, returning the CRC the first frame continues from
+static uint16_t write_header_blocks(const Chip &chip, BitstreamReadWriter &wr)
+{
     wr.insert_dummy_block(0xff, 16);
     wr.insert_dummy_block(0xff, 16);
     // Preamble
@@ -897,30 +962,58 @@ Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string>)
     wr.insert_cmd_uint32(BitstreamCommand::CMD_C4, chip.cfg_c4);
     wr.insert_cmd_uint16(BitstreamCommand::CMD_F5, 0x0000);
     wr.insert_cmd_uint16(BitstreamCommand::RESET_CRC, 0x0000);
-    uint16_t crc16 = CRC16_INIT;
-    {
-        BlockReadWriter blk;
-        blk.crc16.reset_crc16();
-        blk.write_byte((uint8_t)BitstreamCommand::FUSE_DATA);
-        blk.write_byte(0xf0);
-        blk.write_uint16(chip.info.num_frames);
-        crc16 = blk.crc16.crc16;
-        wr.write_block(blk.get());
-    }
-    for (int idx = 0; idx < chip.cram.frames(); idx++) {
-        BlockReadWriter blk;
-        blk.crc16.crc16 = crc16;
-        for (int pos = 0; pos < chip.cram.bits()/8; pos++) {
-            uint8_t byte = 0x00;
-            for (int i = 0; i < 8; i++)
-                byte = (byte << 1) + (chip.cram.get_bit(idx, pos*8+i) ? 1 : 0);
-            blk.write_byte(byte);
+    BlockReadWriter blk;
+    blk.crc16.reset_crc16();
+    blk.write_byte((uint8_t)BitstreamCommand::FUSE_DATA);
+    blk.write_byte(0xf0);
+    blk.write_uint16(chip.info.num_frames);
+    uint16_t crc16 = blk.crc16.crc16;
+    wr.write_block(blk.get());
+    return crc16;
+}
+
+uint16_t Bitstream::crc16(const uint8_t *data, size_t size, uint16_t crc)
+{
+    Crc16 c;
+    c.crc16 = crc;
+    for (size_t i = 0; i < size; i++)
+        c.update_crc16(data[i]);
+    return c.crc16;
+}
+
+void Bitstream::pack_frame(const Chip &chip, int frame, uint8_t *out)
+{
+    const vector<char> &row = chip.cram.data->at(frame);
+    for (int pos = 0; pos < chip.cram.bits() / 8; pos++) {
+        // Most CRAM is clear, so check all eight bits at once first
+        uint64_t chunk;
+        memcpy(&chunk, row.data() + pos * 8, sizeof(chunk));
+        if (chunk == 0) {
+            out[pos] = 0x00;
+            continue;
         }
-        blk.insert_crc16();
-        blk.write_uint32(0);
-        wr.write_block(blk.get());
-        crc16 = CRC16_INIT;
+        uint8_t byte = 0x00;
+        for (int i = 0; i < 8; i++)
+            byte = (byte << 1) + (row[pos * 8 + i] ? 1 : 0);
+        out[pos] = byte;
     }
+}
+
+// Encode one configuration frame, whose CRC starts from crc16
+static void write_frame_block(const Chip &chip, int idx, uint16_t crc16, BitstreamReadWriter &wr)
+{
+    BlockReadWriter blk;
+    blk.crc16.crc16 = crc16;
+    vector<uint8_t> bytes(chip.cram.bits() / 8);
+    Bitstream::pack_frame(chip, idx, bytes.data());
+    blk.write_bytes(bytes.begin(), bytes.size());
+    blk.insert_crc16();
+    blk.write_uint32(0);
+    wr.write_block(blk.get());
+}
+
+static void write_trailer_blocks(BitstreamReadWriter &wr)
+{
     wr.insert_dummy_block(0x00, 15);
     wr.insert_cmd_uint16(BitstreamCommand::PROGRAM_DONE, 0x0000);
     wr.insert_dummy_block(0xff, 16);
@@ -929,11 +1022,140 @@ Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string>)
     wr.insert_dummy_block(0x00, 1162);
     wr.insert_dummy_block(0x00, 1162);
     wr.insert_dummy_block(0x00, 1162);
+}
+
+vector<uint8_t> Bitstream::serialise_header(const Chip &chip)
+{
+    BitstreamReadWriter wr;
+    write_header_blocks(chip, wr);
+    return wr.get();
+}
+
+vector<uint8_t> Bitstream::serialise_frame(const Chip &chip, int frame)
+{
+    // The first frame's CRC carries on from the header, which is cheap enough to encode again
+    uint16_t crc16 = CRC16_INIT;
+    if (frame == 0) {
+        BitstreamReadWriter header;
+        crc16 = write_header_blocks(chip, header);
+    }
+    BitstreamReadWriter wr;
+    write_frame_block(chip, frame, crc16, wr);
+    return wr.get();
+}
+
+vector<uint8_t> Bitstream::serialise_trailer()
+{
+    BitstreamReadWriter wr;
+    write_trailer_blocks(wr);
+    return wr.get();
+}
+
+Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string>) {
+    PhaseTimer timer(Phase::SERIALISE);
+    Metrics::add(Counter::FRAMES_WRITTEN, uint64_t(chip.cram.frames()));
+    BitstreamReadWriter wr;
+    uint16_t crc16 = write_header_blocks(chip, wr);
+    for (int idx = 0; idx < chip.cram.frames(); idx++) {
+        write_frame_block(chip, idx, crc16, wr);
+        crc16 = CRC16_INIT;
+    }
+    write_trailer_blocks(wr);
     return Bitstream(wr.get(), chip.metadata);
 }
 
+static void write_data(std::ostream &out, const vector<uint8_t> &data)
+{
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    Metrics::add(Counter::BYTES_WRITTEN, data.size());
+}
+
+// Encoding and writing overlap, so all of this counts as serialising
+void Bitstream::write_chip_bit(const Chip &chip, const map<string, string>, std::ostream &out)
+{
+    PhaseTimer timer(Phase::SERIALISE);
+    Metrics::add(Counter::FRAMES_WRITTEN, uint64_t(chip.cram.frames()));
+    for (const auto &str : chip.metadata) {
+        out << str;
+        out.put(0x0a);
+        Metrics::add(Counter::BYTES_WRITTEN, str.size() + 1);
+    }
+    uint16_t first_crc16;
+    {
+        BitstreamReadWriter wr;
+        first_crc16 = write_header_blocks(chip, wr);
+        write_data(out, wr.get());
+    }
+    // Frames are encoded in chunks, each chunk being written as soon as it and all those before it are done
+    const int frames_per_chunk = 64;
+    int num_frames = chip.cram.frames();
+    size_t num_chunks = size_t((num_frames + frames_per_chunk - 1) / frames_per_chunk);
+    auto encode_chunk = [&](size_t chunk, vector<uint8_t> &data) {
+        BitstreamReadWriter wr;
+        int first = int(chunk) * frames_per_chunk, last = min(first + frames_per_chunk, num_frames);
+        for (int idx = first; idx < last; idx++)
+            write_frame_block(chip, idx, (idx == 0) ? first_crc16 : CRC16_INIT, wr);
+        data = wr.get();
+    };
+#ifdef NO_THREADS
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        vector<uint8_t> data;
+        encode_chunk(chunk, data);
+        write_data(out, data);
+    }
+#else
+    // Workers take the next chunk in order, the first error is passed on to the caller
+    vector<vector<uint8_t>> chunks(num_chunks);
+    vector<char> ready(num_chunks, 0);
+    atomic<size_t> next{0};
+    exception_ptr error;
+    mutex ready_mutex;
+    condition_variable ready_cv;
+    size_t num_workers = min<size_t>(max(thread::hardware_concurrency(), 1u), num_chunks);
+    vector<thread> workers;
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.emplace_back([&]() {
+            for (size_t chunk = next++; chunk < num_chunks; chunk = next++) {
+                vector<uint8_t> data;
+                exception_ptr chunk_error;
+                try {
+                    encode_chunk(chunk, data);
+                } catch (...) {
+                    chunk_error = current_exception();
+                }
+                lock_guard<mutex> lg(ready_mutex);
+                if (chunk_error && !error)
+                    error = chunk_error;
+                chunks[chunk] = move(data);
+                ready[chunk] = 1;
+                ready_cv.notify_all();
+            }
+        });
+    }
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        vector<uint8_t> data;
+        {
+            unique_lock<mutex> lock(ready_mutex);
+            ready_cv.wait(lock, [&]() { return ready[chunk] != 0; });
+            if (error)
+                break;
+            data = move(chunks[chunk]);
+        }
+        write_data(out, data);
+    }
+    for (auto &worker : workers)
+        worker.join();
+    if (error)
+        rethrow_exception(error);
+#endif
+    BitstreamReadWriter wr;
+    write_trailer_blocks(wr);
+    write_data(out, wr.get());
+}
+
 void Bitstream::write_fuse(const Chip &chip, std::ostream &out)
 {
+    PhaseTimer timer(Phase::WRITE);
     for (int idx = 0; idx < chip.cram.frames(); idx++) {
         for (int pos = 0; pos < chip.cram.bits(); pos++) {
             out << chip.cram.get_bit(idx, pos);
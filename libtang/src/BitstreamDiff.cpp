@@ -0,0 +1,131 @@
+#include "BitstreamDiff.hpp"
+#include "BitDatabase.hpp"
+#include "Chip.hpp"
+#include "Database.hpp"
+#include "Tile.hpp"
+#include "TileIndex.hpp"
+#include "Util.hpp"
+#include <algorithm>
+
+namespace Tang {
+
+bool ChipDiff::empty() const
+{
+    return changed_frames.empty() && other.empty();
+}
+
+// Settings present in a but not in b
+static TileConfig config_difference(const TileConfig &a, const TileConfig &b)
+{
+    TileConfig result;
+    for (const auto &arc : a.carcs)
+        if (find(b.carcs.begin(), b.carcs.end(), arc) == b.carcs.end())
+            result.carcs.push_back(arc);
+    for (const auto &word : a.cwords)
+        if (find(b.cwords.begin(), b.cwords.end(), word) == b.cwords.end())
+            result.cwords.push_back(word);
+    for (const auto &cenum : a.cenums)
+        if (find(b.cenums.begin(), b.cenums.end(), cenum) == b.cenums.end())
+            result.cenums.push_back(cenum);
+    for (const auto &unk : a.cunknowns)
+        if (find(b.cunknowns.begin(), b.cunknowns.end(), unk) == b.cunknowns.end())
+            result.cunknowns.push_back(unk);
+    return result;
+}
+
+template <typename T>
+static void diff_data_map(const string &what, const map<uint8_t, vector<T>> &a, const map<uint8_t, vector<T>> &b,
+                          vector<string> &other)
+{
+    for (const auto &entry : a) {
+        auto found = b.find(entry.first);
+        if (found == b.end())
+            other.push_back(fmt(what << " " << int(entry.first) << " only in first"));
+        else if (found->second != entry.second)
+            other.push_back(fmt(what << " " << int(entry.first) << " differs"));
+    }
+    for (const auto &entry : b)
+        if (!a.count(entry.first))
+            other.push_back(fmt(what << " " << int(entry.first) << " only in second"));
+}
+
+ChipDiff diff_chips(const Chip &a, const Chip &b, const DiffOptions &options)
+{
+    if (a.info.name != b.info.name || a.cram.frames() != b.cram.frames() || a.cram.bits() != b.cram.bits())
+        throw runtime_error("cannot compare chips of different devices " + a.info.name + " and " + b.info.name);
+    ChipDiff diff;
+
+    const int words_per_frame = (a.cram.bits() + 63) / 64;
+    vector<uint64_t> wa(words_per_frame), wb(words_per_frame);
+    bool use_occupancy = a.occupancy.valid() && b.occupancy.valid();
+    for (int f = 0; f < a.cram.frames(); f++) {
+        if (use_occupancy && !a.occupancy.frame_nonzero(f) && !b.occupancy.frame_nonzero(f))
+            continue;
+        a.cram.pack_frame(f, wa.data());
+        b.cram.pack_frame(f, wb.data());
+        if (wa == wb)
+            continue;
+        diff.changed_frames.push_back(f);
+        for (int w = 0; w < words_per_frame; w++) {
+            uint64_t x = wa[w] ^ wb[w];
+            while (x != 0) {
+                int bit = 0;
+                while (((x >> bit) & 1) == 0)
+                    bit++;
+                x &= x - 1;
+                int b_idx = w * 64 + bit;
+                int delta = ((wa[w] >> bit) & 1) ? 1 : -1;
+                bool owned = false;
+                for (size_t id : a.tile_index->tiles_at_bit(f, b_idx)) {
+                    const TileInfo &ti = a.tile_index->info(id);
+                    TileDiff &td = diff.tiles[ti.name];
+                    td.name = ti.name;
+                    td.type = ti.type;
+                    td.bits.push_back(ChangedBit{int(f - ti.frame_offset), int(b_idx - ti.bit_offset), delta});
+                    owned = true;
+                }
+                if (!owned)
+                    diff.unowned_bits.push_back(ChangedBit{f, b_idx, delta});
+            }
+        }
+    }
+
+    if (options.decode_tiles) {
+        for (auto &td : diff.tiles) {
+            auto tile_db = get_tile_bitdata(TileLocator{a.info.family, a.info.name, td.second.type});
+            TileConfig ca = tile_db->tile_cram_to_config(a.tiles.at(td.first)->cram);
+            TileConfig cb = tile_db->tile_cram_to_config(b.tiles.at(td.first)->cram);
+            td.second.removed = config_difference(ca, cb);
+            td.second.added = config_difference(cb, ca);
+        }
+    }
+
+    if (a.usercode != b.usercode)
+        diff.other.push_back("usercode " + uint32_to_hexstr(a.usercode) + " -> " + uint32_to_hexstr(b.usercode));
+    if (a.cfg1 != b.cfg1)
+        diff.other.push_back("cfg1 " + uint32_to_hexstr(a.cfg1) + " -> " + uint32_to_hexstr(b.cfg1));
+    if (a.cfg2 != b.cfg2)
+        diff.other.push_back("cfg2 " + uint32_to_hexstr(a.cfg2) + " -> " + uint32_to_hexstr(b.cfg2));
+    if (a.cfg_c4 != b.cfg_c4)
+        diff.other.push_back("cfg_c4 " + uint32_to_hexstr(a.cfg_c4) + " -> " + uint32_to_hexstr(b.cfg_c4));
+    if (a.cfg_c5 != b.cfg_c5)
+        diff.other.push_back("cfg_c5 " + uint32_to_hexstr(a.cfg_c5) + " -> " + uint32_to_hexstr(b.cfg_c5));
+    if (a.cfg_ca != b.cfg_ca)
+        diff.other.push_back("cfg_ca " + uint32_to_hexstr(a.cfg_ca) + " -> " + uint32_to_hexstr(b.cfg_ca));
+    diff_data_map("bram", a.bram_data, b.bram_data, diff.other);
+    diff_data_map("pll", a.pll_data, b.pll_data, diff.other);
+    if (!options.ignore_metadata && a.metadata != b.metadata) {
+        size_t count = diff.other.size();
+        for (const auto &meta : a.metadata)
+            if (find(b.metadata.begin(), b.metadata.end(), meta) == b.metadata.end())
+                diff.other.push_back("metadata only in first: " + meta);
+        for (const auto &meta : b.metadata)
+            if (find(a.metadata.begin(), a.metadata.end(), meta) == a.metadata.end())
+                diff.other.push_back("metadata only in second: " + meta);
+        if (diff.other.size() == count)
+            diff.other.push_back("metadata order differs");
+    }
+    return diff;
+}
+
+}
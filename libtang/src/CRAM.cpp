@@ -1,11 +1,53 @@
 #include "CRAM.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <stdexcept>
 
 namespace Tang {
+// Pack count bits stored one per char into 64-bit words, which must already be zeroed
+static void pack_bits(const char *bits, int count, uint64_t *out) {
+    int j = 0;
+    // Most CRAM is clear, so skip eight bits at a time where none are set
+    for (; j + 8 <= count; j += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, bits + j, sizeof(chunk));
+        if (chunk == 0)
+            continue;
+        for (int k = j; k < j + 8; k++) {
+            if (bits[k])
+                out[k / 64] |= (1ULL << (k % 64));
+        }
+    }
+    for (; j < count; j++) {
+        if (bits[j])
+            out[j / 64] |= (1ULL << (j % 64));
+    }
+}
+
+uint64_t CRAMGeneration::record() {
+    uint64_t c = count;
+    if ((c & 1) == 0) {
+#ifdef NO_THREADS
+        count = ++c;
+#else
+        // A concurrent write may have moved the count on already, either way it is odd afterwards
+        if (!count.compare_exchange_strong(c, c + 1))
+            return record();
+        c++;
+#endif
+    }
+    return c;
+}
+
+uint64_t CRAMGeneration::current() const {
+    return count;
+}
+
 char &CRAMView::bit(int frame, int bit) const {
     assert(frame < frame_count);
     assert(bit < bit_count);
+    generation->changed();
     return cram_data->at(frame_offset + frame).at(bit_offset + bit);
 }
 
@@ -14,17 +56,19 @@ int CRAMView::frames() const { return frame_count; }
 int CRAMView::bits() const { return bit_count; }
 
 bool CRAMView::get_bit(int frame, int biti) const {
-    return bool(bit(frame, biti));
+    assert(frame < frame_count);
+    assert(biti < bit_count);
+    return cram_data->at(frame_offset + frame).at(bit_offset + biti) != 0;
 }
 
 void CRAMView::set_bit(int frame, int biti, bool value) {
     bit(frame, biti) = value;
 }
 
-CRAMView::CRAMView(shared_ptr<vector<vector<char>>> data, int frame_offset, int bit_offset, int frame_count,
-                   int bit_count)
+CRAMView::CRAMView(shared_ptr<vector<vector<char>>> data, shared_ptr<CRAMGeneration> generation, int frame_offset,
+                   int bit_offset, int frame_count, int bit_count)
         : frame_offset(frame_offset), bit_offset(bit_offset), frame_count(frame_count),
-          bit_count(bit_count), cram_data(data) {}
+          bit_count(bit_count), cram_data(data), generation(generation) {}
 
 void CRAMView::clear() {
     for (int i = 0; i < frame_count; i++) {
@@ -34,14 +78,34 @@ void CRAMView::clear() {
     }
 }
 
+void CRAMView::pack(PackedCRAM &out) const {
+    out.frame_count = frame_count;
+    out.bit_count = bit_count;
+    out.words_per_frame = (bit_count + 63) / 64;
+    out.words.assign(size_t(frame_count) * out.words_per_frame, 0);
+    for (int i = 0; i < frame_count; i++)
+        pack_bits(cram_data->at(frame_offset + i).data() + bit_offset, bit_count,
+                  out.words.data() + size_t(i) * out.words_per_frame);
+}
+
+uint64_t PackedCRAM::hash() const {
+    uint64_t h = (uint64_t(frame_count) << 32) | uint32_t(bit_count);
+    for (auto w : words) {
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
 CRAMDelta operator-(const CRAMView &a, const CRAMView &b) {
     if ((a.bits() != b.bits()) || (a.frames() != b.frames()))
         throw runtime_error("cannot compare CRAMViews of different sizes");
     CRAMDelta delta;
     for (int i = 0; i < a.frames(); i++) {
         for (int j = 0; j < b.bits(); j++) {
-            if (a.bit(i, j) != b.bit(i, j)) {
-                delta.push_back(ChangedBit{i, j, int(a.bit(i, j)) - int(b.bit(i, j))});
+            bool va = a.get_bit(i, j), vb = b.get_bit(i, j);
+            if (va != vb) {
+                delta.push_back(ChangedBit{i, j, int(va) - int(vb)});
             }
         }
     }
@@ -51,14 +115,16 @@ CRAMDelta operator-(const CRAMView &a, const CRAMView &b) {
 CRAM::CRAM(int frames, int bits) {
     data = make_shared<vector<vector<char>>>();
     data->resize(frames, vector<char>(bits));
+    generation = make_shared<CRAMGeneration>();
 }
 
 char &CRAM::bit(int frame, int bit) const {
+    generation->changed();
     return data->at(frame).at(bit);
 }
 
 bool CRAM::get_bit(int frame, int biti) const {
-    return bool(bit(frame, biti));
+    return data->at(frame).at(biti) != 0;
 }
 
 void CRAM::set_bit(int frame, int biti, bool value) {
@@ -69,8 +135,339 @@ int CRAM::frames() const { return int(data->size()); }
 
 int CRAM::bits() const { return int(data->at(0).size()); }
 
+void CRAM::pack_frame(int frame, uint64_t *out) const {
+    const vector<char> &row = data->at(frame);
+    fill(out, out + (row.size() + 63) / 64, 0);
+    pack_bits(row.data(), int(row.size()), out);
+}
+
 CRAMView CRAM::make_view(int frame_offset, int bit_offset, int frame_count, int bit_count) {
-    return CRAMView(data, frame_offset, bit_offset, frame_count, bit_count);
+    return CRAMView(data, generation, frame_offset, bit_offset, frame_count, bit_count);
+}
+
+CRAMOccupancy::CRAMOccupancy() {}
+
+CRAMOccupancy::CRAMOccupancy(int frames, int bits)
+        : frame_count(frames), column_count((bits + 63) / 64), nonzero(size_t(frame_count) * column_count) {}
+
+void CRAMOccupancy::mark(int frame, int column) {
+    nonzero.at(size_t(frame) * column_count + column) = 1;
+    finalised = false;
+}
+
+void CRAMOccupancy::finalise(const CRAM &cram) {
+    prefix.resize(size_t(column_count) * (frame_count + 1));
+    for (int c = 0; c < column_count; c++) {
+        uint32_t *p = prefix.data() + size_t(c) * (frame_count + 1);
+        p[0] = 0;
+        for (int f = 0; f < frame_count; f++)
+            p[f + 1] = p[f] + nonzero[size_t(f) * column_count + c];
+    }
+    source = cram.generation;
+    source_generation = source->record();
+    finalised = true;
+}
+
+void CRAMOccupancy::scan(const CRAM &cram) {
+    *this = CRAMOccupancy(cram.frames(), cram.bits());
+    for (int f = 0; f < cram.frames(); f++) {
+        const vector<char> &row = cram.data->at(f);
+        for (size_t b = 0; b < row.size(); b++) {
+            if (row[b]) {
+                nonzero[size_t(f) * column_count + b / 64] = 1;
+                // Skip to the next column
+                b |= 63;
+            }
+        }
+    }
+    finalise(cram);
+}
+
+bool CRAMOccupancy::valid() const {
+    return finalised && source->current() == source_generation;
+}
+
+bool CRAMOccupancy::column_nonzero(int frame, int column) const {
+    return nonzero.at(size_t(frame) * column_count + column) != 0;
+}
+
+bool CRAMOccupancy::frame_nonzero(int frame) const {
+    for (int c = 0; c < column_count; c++)
+        if (column_nonzero(frame, c))
+            return true;
+    return false;
+}
+
+bool CRAMOccupancy::region_zero(int frame_offset, int bit_offset, int frame_count, int bit_count) const {
+    assert(finalised);
+    if (frame_count <= 0 || bit_count <= 0)
+        return true;
+    int first_col = bit_offset / 64, last_col = (bit_offset + bit_count - 1) / 64;
+    for (int c = first_col; c <= last_col; c++) {
+        const uint32_t *p = prefix.data() + size_t(c) * (this->frame_count + 1);
+        if (p[frame_offset + frame_count] != p[frame_offset])
+            return false;
+    }
+    return true;
+}
+
+
+static void put_varint(vector<uint8_t> &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static uint64_t get_varint(const uint8_t *&ptr) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *ptr++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+static uint64_t hash_bytes(const vector<uint8_t> &bytes) {
+    uint64_t h = bytes.size();
+    for (auto b : bytes) {
+        h = (h ^ b) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// Call f(word index, word) for each word of an encoded frame, which are all the nonzero words
+template <typename F>
+static void for_each_word(const vector<uint8_t> &encoded, int words_per_frame, F f) {
+    const uint8_t *ptr = encoded.data(), *end = ptr + encoded.size();
+    size_t idx = 0;
+    while (ptr < end) {
+        idx += get_varint(ptr);
+        size_t count = get_varint(ptr);
+        if (idx + count > size_t(words_per_frame))
+            throw runtime_error("compressed frame does not fit CRAM size");
+        for (size_t i = 0; i < count; i++, idx++) {
+            uint64_t word;
+            memcpy(&word, ptr, sizeof(word));
+            ptr += sizeof(word);
+            f(idx, word);
+        }
+    }
+}
+
+CRAMFramePool::CRAMFramePool() {
+    frames.emplace_back();
+    index.emplace(hash_bytes(frames.front()), 0);
+}
+
+void CRAMFramePool::encode(const uint64_t *words, int words_per_frame, vector<uint8_t> &out) {
+    out.clear();
+    int idx = 0, last_end = 0;
+    while (idx < words_per_frame) {
+        if (words[idx] == 0) {
+            idx++;
+            continue;
+        }
+        int run_end = idx;
+        while (run_end < words_per_frame && words[run_end] != 0)
+            run_end++;
+        put_varint(out, uint64_t(idx - last_end));
+        put_varint(out, uint64_t(run_end - idx));
+        size_t pos = out.size();
+        out.resize(pos + sizeof(uint64_t) * (run_end - idx));
+        memcpy(out.data() + pos, words + idx, sizeof(uint64_t) * (run_end - idx));
+        idx = last_end = run_end;
+    }
+}
+
+uint32_t CRAMFramePool::intern(const vector<uint8_t> &encoded) {
+    if (encoded.empty())
+        return 0;
+    uint64_t h = hash_bytes(encoded);
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(pool_mutex);
+#endif
+    auto range = index.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it)
+        if (frames.at(it->second) == encoded)
+            return it->second;
+    uint32_t id = uint32_t(frames.size());
+    frames.push_back(encoded);
+    frames.back().shrink_to_fit();
+    index.emplace(h, id);
+    encoded_bytes += encoded.size();
+    return id;
+}
+
+const vector<uint8_t> &CRAMFramePool::get(uint32_t id) const {
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(pool_mutex);
+#endif
+    return frames.at(id);
+}
+
+void CRAMFramePool::decode(uint32_t id, uint64_t *out, int words_per_frame) const {
+    fill(out, out + words_per_frame, 0);
+    decode_xor(id, out, words_per_frame);
+}
+
+void CRAMFramePool::decode_xor(uint32_t id, uint64_t *out, int words_per_frame) const {
+    if (id == 0)
+        return;
+    for_each_word(get(id), words_per_frame, [out](size_t idx, uint64_t word) { out[idx] ^= word; });
+}
+
+uint64_t CRAMFramePool::decode_word(uint32_t id, int word, int words_per_frame) const {
+    if (id == 0)
+        return 0;
+    // Runs of literal words are stepped over without reading them
+    const vector<uint8_t> &encoded = get(id);
+    const uint8_t *ptr = encoded.data(), *end = ptr + encoded.size();
+    size_t idx = 0;
+    while (ptr < end) {
+        idx += get_varint(ptr);
+        size_t count = get_varint(ptr);
+        if (idx + count > size_t(words_per_frame))
+            throw runtime_error("compressed frame does not fit CRAM size");
+        if (size_t(word) < idx)
+            return 0;
+        if (size_t(word) < idx + count) {
+            uint64_t value;
+            memcpy(&value, ptr + sizeof(value) * (word - idx), sizeof(value));
+            return value;
+        }
+        ptr += sizeof(uint64_t) * count;
+        idx += count;
+    }
+    return 0;
+}
+
+size_t CRAMFramePool::size() const {
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(pool_mutex);
+#endif
+    return frames.size();
+}
+
+size_t CRAMFramePool::memory_usage() const {
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(pool_mutex);
+#endif
+    // Frame contents, the vectors holding them and the index entries
+    size_t per_frame = sizeof(vector<uint8_t>) + sizeof(pair<uint64_t, uint32_t>) + 2 * sizeof(void *);
+    return encoded_bytes + frames.size() * per_frame;
+}
+
+CRAMSnapshot::CRAMSnapshot(const CRAM &cram, shared_ptr<CRAMFramePool> pool)
+        : pool(pool), frame_count(cram.frames()), bit_count(cram.bits()), words_per_frame((cram.bits() + 63) / 64) {
+    vector<uint64_t> words(words_per_frame);
+    vector<uint8_t> encoded;
+    frame_ids.resize(frame_count);
+    for (int f = 0; f < frame_count; f++) {
+        cram.pack_frame(f, words.data());
+        CRAMFramePool::encode(words.data(), words_per_frame, encoded);
+        frame_ids[f] = pool->intern(encoded);
+    }
+}
+
+CRAMSnapshot::CRAMSnapshot(const CRAM &cram, shared_ptr<const CRAMSnapshot> base)
+        : pool(base->pool), base(base->base ? base->base : base), frame_count(cram.frames()), bit_count(cram.bits()),
+          words_per_frame((cram.bits() + 63) / 64) {
+    if (frame_count != this->base->frame_count || bit_count != this->base->bit_count)
+        throw runtime_error("cannot snapshot CRAM against a base of a different size");
+    vector<uint64_t> words(words_per_frame), base_words(words_per_frame);
+    vector<uint8_t> encoded;
+    for (int f = 0; f < frame_count; f++) {
+        cram.pack_frame(f, words.data());
+        this->base->get_frame(f, base_words.data());
+        bool differs = false;
+        for (int i = 0; i < words_per_frame; i++) {
+            words[i] ^= base_words[i];
+            differs |= (words[i] != 0);
+        }
+        if (!differs)
+            continue;
+        CRAMFramePool::encode(words.data(), words_per_frame, encoded);
+        changed.emplace_back(uint32_t(f), pool->intern(encoded));
+    }
+    changed.shrink_to_fit();
+}
+
+int CRAMSnapshot::frames() const {
+    return frame_count;
+}
+
+int CRAMSnapshot::bits() const {
+    return bit_count;
+}
+
+void CRAMSnapshot::get_frame(int frame, uint64_t *out) const {
+    if (frame < 0 || frame >= frame_count)
+        throw out_of_range("frame index out of range");
+    if (!base) {
+        pool->decode(frame_ids[frame], out, words_per_frame);
+        return;
+    }
+    base->get_frame(frame, out);
+    auto found = lower_bound(changed.begin(), changed.end(), make_pair(uint32_t(frame), uint32_t(0)));
+    if (found != changed.end() && found->first == uint32_t(frame))
+        pool->decode_xor(found->second, out, words_per_frame);
+}
+
+bool CRAMSnapshot::get_bit(int frame, int bit) const {
+    if (bit < 0 || bit >= bit_count)
+        throw out_of_range("bit index out of range");
+    if (frame < 0 || frame >= frame_count)
+        throw out_of_range("frame index out of range");
+    uint64_t word;
+    if (!base) {
+        word = pool->decode_word(frame_ids[frame], bit / 64, words_per_frame);
+    } else {
+        word = pool->decode_word(base->frame_ids[frame], bit / 64, words_per_frame);
+        auto found = lower_bound(changed.begin(), changed.end(), make_pair(uint32_t(frame), uint32_t(0)));
+        if (found != changed.end() && found->first == uint32_t(frame))
+            word ^= pool->decode_word(found->second, bit / 64, words_per_frame);
+    }
+    return ((word >> (bit % 64)) & 1) != 0;
+}
+
+bool CRAMSnapshot::frame_changed(int frame) const {
+    return binary_search(changed.begin(), changed.end(), make_pair(uint32_t(frame), uint32_t(0)),
+                         [](const pair<uint32_t, uint32_t> &a, const pair<uint32_t, uint32_t> &b) {
+                             return a.first < b.first;
+                         });
+}
+
+CRAM CRAMSnapshot::to_cram() const {
+    CRAM cram(frame_count, bit_count);
+    restore(cram);
+    return cram;
+}
+
+void CRAMSnapshot::restore(CRAM &cram) const {
+    if (cram.frames() != frame_count || cram.bits() != bit_count)
+        throw runtime_error("cannot restore snapshot into CRAM of a different size");
+    vector<uint64_t> words(words_per_frame);
+    for (int f = 0; f < frame_count; f++) {
+        get_frame(f, words.data());
+        vector<char> &row = cram.data->at(f);
+        fill(row.begin(), row.end(), 0);
+        for (int i = 0; i < words_per_frame; i++) {
+            if (words[i] == 0)
+                continue;
+            for (int b = i * 64; b < min(i * 64 + 64, bit_count); b++)
+                row[b] = char((words[i] >> (b % 64)) & 1);
+        }
+    }
+    cram.generation->changed();
+}
+
+size_t CRAMSnapshot::memory_usage() const {
+    return sizeof(*this) + frame_ids.capacity() * sizeof(uint32_t) +
+           changed.capacity() * sizeof(pair<uint32_t, uint32_t>);
 }
 
 }
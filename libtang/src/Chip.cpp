@@ -3,6 +3,8 @@
 #include "Database.hpp"
 #include "Util.hpp"
 #include "BitDatabase.hpp"
+#include "TileIndex.hpp"
+#include "Metrics.hpp"
 #include <algorithm>
 #include <iostream>
 using namespace std;
@@ -17,19 +19,66 @@ Chip::Chip(uint32_t idcode) : Chip(get_chip_info(find_device_by_idcode(idcode)))
 
 Chip::Chip(const Tang::ChipInfo &info) : info(info), cram(info.num_frames, info.bits_per_frame)
 {
-    vector<TileInfo> allTiles = get_device_tilegrid(DeviceLocator{info.family, info.name, info.package});
+    PhaseTimer timer(Phase::CHIP_CONSTRUCTION);
+    DeviceLocator part{info.family, info.name, info.package};
+    vector<TileInfo> allTiles = get_device_tilegrid(part);
     for (const auto &tile : allTiles) {
         tiles[tile.name] = make_shared<Tile>(tile, *this);
-        int row, col;
-        tie(row, col) = tile.get_row_col();
-        if (int(tiles_at_location.size()) <= row) {
-            tiles_at_location.resize(row+1);
-        }
-        if (int(tiles_at_location.at(row).size()) <= col) {
-            tiles_at_location.at(row).resize(col+1);
-        }
-        tiles_at_location.at(row).at(col).push_back(make_pair(tile.name, tile.type));
     }
+    tile_index = get_device_tile_index(part, allTiles);
+    indexed_tiles.reserve(tile_index->size());
+    for (size_t id = 0; id < tile_index->size(); id++)
+        indexed_tiles.push_back(tiles.at(tile_index->info(id).name));
+    for (uint32_t id : tile_index->type_order())
+        tiles_by_type.push_back(indexed_tiles.at(id).get());
+    for (uint32_t id : tile_index->location_order())
+        tiles_by_location.push_back(indexed_tiles.at(id).get());
+}
+
+TileSpan Chip::get_tile_span_by_type(Symbol type) const
+{
+    auto range = tile_index->type_range(type);
+    return TileSpan(tiles_by_type.begin() + range.first, tiles_by_type.begin() + range.second);
+}
+
+TileSpan Chip::get_tile_span_by_position(int row, int col) const
+{
+    auto range = tile_index->location_range(row, col);
+    return TileSpan(tiles_by_location.begin() + range.first, tiles_by_location.begin() + range.second);
+}
+
+vector<TileSpan> Chip::get_tile_spans_in_region(int row0, int col0, int row1, int col1) const
+{
+    vector<TileSpan> result;
+    row0 = max(row0, 0);
+    col0 = max(col0, 0);
+    row1 = min(row1, tile_index->rows() - 1);
+    col1 = min(col1, tile_index->cols() - 1);
+    if (col1 < col0)
+        return result;
+    // Locations are stored row major, so the tiles of consecutive columns within a row are contiguous
+    for (int row = row0; row <= row1; row++) {
+        size_t first = tile_index->location_range(row, col0).first;
+        size_t last = tile_index->location_range(row, col1).second;
+        result.push_back(TileSpan(tiles_by_location.begin() + first, tiles_by_location.begin() + last));
+    }
+    return result;
+}
+
+vector<shared_ptr<Tile>> Chip::get_tiles_at_bit(int frame, int bit) const
+{
+    vector<shared_ptr<Tile>> result;
+    for (size_t id : tile_index->tiles_at_bit(frame, bit))
+        result.push_back(indexed_tiles.at(id));
+    return result;
+}
+
+vector<shared_ptr<Tile>> Chip::get_tiles_in_frames(int first_frame, int last_frame) const
+{
+    vector<shared_ptr<Tile>> result;
+    for (size_t id : tile_index->tiles_in_frames(first_frame, last_frame))
+        result.push_back(indexed_tiles.at(id));
+    return result;
 }
 
 shared_ptr<Tile> Chip::get_tile_by_name(string name)
@@ -40,25 +89,36 @@ shared_ptr<Tile> Chip::get_tile_by_name(string name)
 vector<shared_ptr<Tile>> Chip::get_tiles_by_position(int row, int col)
 {
     vector<shared_ptr<Tile>> result;
-    for (const auto &tile : tiles) {
-        if (tile.second->info.get_row_col() == make_pair(row, col))
-            result.push_back(tile.second);
-    }
+    auto range = tile_index->location_range(row, col);
+    for (size_t i = range.first; i < range.second; i++)
+        result.push_back(indexed_tiles.at(tile_index->location_order().at(i)));
+    sort(result.begin(), result.end(),
+         [](const shared_ptr<Tile> &a, const shared_ptr<Tile> &b) { return a->info.name < b->info.name; });
     return result;
 }
 
-string Chip::get_tile_by_position_and_type(int row, int col, string type) {
-    for (const auto &tile : tiles_at_location.at(row).at(col)) {
-        if (tile.second == type)
-            return tile.first;
+string Chip::get_tile_by_position_and_type(int row, int col, const string &type) const
+{
+    if (row < 0 || row >= tile_index->rows() || col < 0 || col >= tile_index->cols())
+        throw out_of_range(fmt("X" << col << "Y" << row << " is outside of the tile grid"));
+    // Looking the name up rather than interning it keeps arbitrary queries out of the symbol table
+    auto type_sym = Symbol::find(type);
+    if (type_sym) {
+        for (const Tile *tile : get_tile_span_by_position(row, col)) {
+            if (tile->info.type == *type_sym)
+                return tile->info.name;
+        }
     }
     throw runtime_error(fmt("no suitable tile found at X" << col << "Y" << row));
 }
 
-string Chip::get_tile_by_position_and_type(int row, int col, set<string> type) {
-    for (const auto &tile : tiles_at_location.at(row).at(col)) {
-        if (type.find(tile.second) != type.end())
-            return tile.first;
+string Chip::get_tile_by_position_and_type(int row, int col, const set<string> &type) const
+{
+    if (row < 0 || row >= tile_index->rows() || col < 0 || col >= tile_index->cols())
+        throw out_of_range(fmt("X" << col << "Y" << row << " is outside of the tile grid"));
+    for (const Tile *tile : get_tile_span_by_position(row, col)) {
+        if (type.find(tile->info.type) != type.end())
+            return tile->info.name;
     }
     throw runtime_error(fmt("no suitable tile found at X" << col << "Y" << row));
 }
@@ -67,10 +127,12 @@ string Chip::get_tile_by_position_and_type(int row, int col, set<string> type) {
 vector<shared_ptr<Tile>> Chip::get_tiles_by_type(string type)
 {
     vector<shared_ptr<Tile>> result;
-    for (const auto &tile : tiles) {
-        if (tile.second->info.type == type)
-            result.push_back(tile.second);
-    }
+    auto type_sym = Symbol::find(type);
+    if (!type_sym)
+        return result;
+    auto range = tile_index->type_range(*type_sym);
+    for (size_t i = range.first; i < range.second; i++)
+        result.push_back(indexed_tiles.at(tile_index->type_order().at(i)));
     return result;
 }
 
@@ -83,6 +145,43 @@ vector<shared_ptr<Tile>> Chip::get_all_tiles()
     return result;
 }
 
+void Chip::update_occupancy()
+{
+    occupancy.scan(cram);
+}
+
+bool Chip::is_tile_zero(const Tile &tile) const
+{
+    const TileInfo &ti = tile.info;
+    if (occupancy.valid() &&
+        occupancy.region_zero(int(ti.frame_offset), int(ti.bit_offset), int(ti.num_frames), int(ti.bits_per_frame)))
+        return true;
+    for (size_t f = ti.frame_offset; f < ti.frame_offset + ti.num_frames; f++) {
+        const vector<char> &row = cram.data->at(f);
+        auto begin = row.begin() + ti.bit_offset;
+        if (any_of(begin, begin + ti.bits_per_frame, [](char c) { return c != 0; }))
+            return false;
+    }
+    return true;
+}
+
+bool Chip::is_tile_equal(const Tile &tile, const Chip &other) const
+{
+    const TileInfo &ti = tile.info;
+    if (occupancy.valid() && other.occupancy.valid()) {
+        int fo = int(ti.frame_offset), bo = int(ti.bit_offset), fc = int(ti.num_frames), bc = int(ti.bits_per_frame);
+        if (occupancy.region_zero(fo, bo, fc, bc) && other.occupancy.region_zero(fo, bo, fc, bc))
+            return true;
+    }
+    for (size_t f = ti.frame_offset; f < ti.frame_offset + ti.num_frames; f++) {
+        const vector<char> &row = cram.data->at(f), &other_row = other.cram.data->at(f);
+        auto begin = row.begin() + ti.bit_offset;
+        if (!equal(begin, begin + ti.bits_per_frame, other_row.begin() + ti.bit_offset))
+            return false;
+    }
+    return true;
+}
+
 int Chip::get_max_row() const
 {
     return info.max_row;
@@ -97,6 +196,8 @@ ChipDelta operator-(const Chip &a, const Chip &b)
 {
     ChipDelta delta;
     for (const auto &tile : a.tiles) {
+        if (a.is_tile_equal(*tile.second, b))
+            continue;
         CRAMDelta cd = tile.second->cram - b.tiles.at(tile.first)->cram;
         if (!cd.empty())
             delta[tile.first] = cd;
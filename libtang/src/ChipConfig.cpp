@@ -3,8 +3,17 @@
 #include "BitDatabase.hpp"
 #include "Database.hpp"
 #include "Tile.hpp"
+#include "DecodeCache.hpp"
+#include "TileIndex.hpp"
+#include "Scanner.hpp"
+#include "HexCodec.hpp"
+#include <algorithm>
 #include <sstream>
 #include <iostream>
+#include <boost/optional.hpp>
+#ifndef NO_THREADS
+#include <thread>
+#endif
 
 namespace Tang {
 
@@ -25,28 +34,19 @@ string ChipConfig::to_string() const
             ss << endl;
         }
     }
+    string hex;
     for (const auto &bram : bram_data) {
         ss << ".bram_init " << (int)bram.first << endl;
-        ios_base::fmtflags f( ss.flags() );
-        for (size_t i = 0; i < bram.second.size(); i++) {
-            ss << setw(2) << setfill('0') << hex << (int)bram.second.at(i);
-            if (i % 32 == 31)
-                ss << endl;
-            else
-                ss << " ";
-        }
-        ss.flags(f);
-        ss << endl;
+        hex.clear();
+        append_hex_lines(hex, bram.second.data(), bram.second.size());
+        ss << hex << endl;
     }
     for (const auto &pll : pll_data) {
         ss << ".pll_init " << (int)pll.first << endl;
-        ios_base::fmtflags f( ss.flags() );
-        for (size_t i = 0; i < pll.second.size() / 32; i++) {
-            ss << setw(2) << setfill('0') << hex << (int)pll.second.at(i);
-        }
-        ss << endl;
-        ss.flags(f);
-        ss << endl;
+        // The data is repeated 32 times, so only the first copy is written
+        hex.clear();
+        append_hex(hex, pll.second.data(), pll.second.size() / 32);
+        ss << hex << endl << endl;
     }
     for (const auto &tg : tilegroups) {
         ss << ".tile_group";
@@ -62,80 +62,83 @@ string ChipConfig::to_string() const
 
 ChipConfig ChipConfig::from_string(const string &config)
 {
-    stringstream ss(config);
+    return from_text(config.data(), config.data() + config.size());
+}
+
+// Parse the decimal index of a .bram_init or .pll_init block
+static uint8_t block_index(Scanner &sc, const string &verb)
+{
+    boost::string_ref tok = record_token(sc);
+    const char *p = tok.begin();
+    int value;
+    if (!Scanner::parse_uint(p, tok.end(), value) || p != tok.end() || value > UINT8_MAX)
+        throw runtime_error("invalid index " + tok.to_string() + " for " + verb);
+    return uint8_t(value);
+}
+
+ChipConfig ChipConfig::from_text(const char *begin, const char *end)
+{
+    Scanner sc(begin, end);
+    SymbolCache symbols;
     ChipConfig cc;
-    while (!skip_check_eof(ss)) {
-        std::string verb;
-        ss >> verb;
+    while (!sc.check_eof()) {
+        boost::string_ref verb = sc.token();
         if (verb == ".device") {
-            ss >> cc.chip_name;
+            cc.chip_name = record_token(sc).to_string();
         } else if (verb == ".package") {
-            ss >> cc.chip_package;
+            cc.chip_package = record_token(sc).to_string();
         } else if (verb == ".comment") {
-            std::string line;
-            ss.get(); //skip space
-            getline(ss, line);
-            cc.metadata.push_back(line);
+            // Everything after the separating space is kept, including any further whitespace
+            boost::string_ref text = sc.line();
+            if (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+                text.remove_prefix(1);
+            cc.metadata.push_back(text.to_string());
         } else if (verb == ".tile") {
-            std::string tilename;
-            ss >> tilename;
-            TileConfig tc;
-            ss >> tc;
-            cc.tiles[tilename] = tc;
+            TileConfig &tc = cc.tiles[record_token(sc).to_string()];
+            tc = TileConfig();
+            scan_tile_config(sc, tc, symbols);
         } else if (verb == ".sysconfig") {
-            std::string key, value;
-            ss >> key >> value;
-            cc.sysconfig[key] = value;
+            string key = record_token(sc).to_string();
+            cc.sysconfig[key] = record_token(sc).to_string();
         } else if (verb == ".bram_init") {
-            uint16_t bram;
-            ss >> bram;
-            ios_base::fmtflags f(ss.flags());
-            while (!skip_check_eor(ss)) {
-                uint8_t value;
-                ss >> hex >> value;
-                cc.bram_data[bram].push_back(value);
-            }
-            ss.flags(f);
+            vector<uint8_t> &data = cc.bram_data[block_index(sc, ".bram_init")];
+            sc.seek(decode_hex_record(sc.position(), end, data));
         } else if (verb == ".pll_init") {
-            uint16_t pll;
-            ss >> pll;
-            ios_base::fmtflags f(ss.flags());
-            std::vector<uint8_t> data;
-            while (!skip_check_eor(ss)) {
-                uint8_t value;
-                ss >> hex >> value;
-                data.push_back(value);
-            }
-            cc.pll_data[pll].clear();
-            for(int i=0;i<32;i++)
-                cc.pll_data[pll].insert(cc.pll_data[pll].end(), data.begin(), data.end());
-            ss.flags(f);
+            vector<uint8_t> &pll = cc.pll_data[block_index(sc, ".pll_init")];
+            vector<uint8_t> data;
+            sc.seek(decode_hex_record(sc.position(), end, data));
+            pll.clear();
+            pll.reserve(data.size() * 32);
+            for (int i = 0; i < 32; i++)
+                pll.insert(pll.end(), data.begin(), data.end());
         } else if (verb == ".tile_group") {
             TileGroup tg;
-            std::string line;
-            getline(ss, line);
-            std::stringstream ss2(line);
-
-            std::string tile;
-            while (ss2) {
-                ss2 >> tile;
-                tg.tiles.push_back(tile);
-            }
-            ss >> tg.config;
-            cc.tilegroups.push_back(tg);
+            while (!sc.check_eol())
+                tg.tiles.push_back(sc.token().to_string());
+            scan_tile_config(sc, tg.config, symbols);
+            cc.tilegroups.push_back(move(tg));
         } else {
-            throw runtime_error("unrecognised config entry " + verb);
+            throw runtime_error("unrecognised config entry " + verb.to_string());
         }
     }
     return cc;
 }
 
-Chip ChipConfig::to_chip() const
+ChipConfig ChipConfig::from_file(const string &filename)
 {
-    Chip c(chip_name, chip_package);
-    c.metadata = metadata;
-    c.bram_data = bram_data;
-    c.pll_data = pll_data;
+    string text;
+    if (!read_file(filename, text))
+        throw runtime_error("failed to read config file " + filename);
+    return from_text(text.data(), text.data() + text.size());
+}
+
+// Copy the settings of a configuration into a chip for its device
+static void apply_chip_settings(const ChipConfig &cc, Chip &c)
+{
+    const map<string, string> &sysconfig = cc.sysconfig;
+    c.metadata = cc.metadata;
+    c.bram_data = cc.bram_data;
+    c.pll_data = cc.pll_data;
 
     if (sysconfig.count("cfg1")) 
         c.cfg1 = parse_uint32(sysconfig.at("cfg1"));
@@ -147,6 +150,70 @@ Chip ChipConfig::to_chip() const
         c.cfg_c5 = parse_uint32(sysconfig.at("cfg_c5"));
     if (sysconfig.count("cfg_ca")) 
         c.cfg_ca = parse_uint32(sysconfig.at("cfg_ca"));
+}
+
+// Find the device and package named at the top of a config, without parsing the rest of it
+static bool find_device(const char *begin, const char *end, string &name, string &package)
+{
+    Scanner sc(begin, end);
+    bool have_name = false, have_package = false;
+    while (!(have_name && have_package) && !sc.check_eof()) {
+        boost::string_ref verb = sc.token();
+        if (verb == ".device") {
+            name = sc.token().to_string();
+            have_name = true;
+        } else if (verb == ".package") {
+            package = sc.token().to_string();
+            have_package = true;
+        } else if (verb == ".comment") {
+            sc.line();
+        } else {
+            return false;
+        }
+    }
+    return have_name && have_package;
+}
+
+Chip ChipConfig::text_to_chip(const char *begin, const char *end)
+{
+    string name, package;
+    if (!find_device(begin, end, name, package))
+        return from_text(begin, end).to_chip();
+#ifdef NO_THREADS
+    return from_text(begin, end).to_chip();
+#else
+    // Building the chip loads the device's tilegrid, which takes about as long as parsing a large config
+    ChipConfig cc;
+    exception_ptr error;
+    thread parser([&]() {
+        try {
+            cc = from_text(begin, end);
+        } catch (...) {
+            error = current_exception();
+        }
+    });
+    boost::optional<Chip> c;
+    try {
+        c.emplace(name, package);
+    } catch (...) {
+        parser.join();
+        throw;
+    }
+    parser.join();
+    if (error)
+        rethrow_exception(error);
+    // A later record may have named another device
+    if (cc.chip_name != name || cc.chip_package != package)
+        return cc.to_chip();
+    apply_chip_settings(cc, *c);
+    return move(*c);
+#endif
+}
+
+Chip ChipConfig::to_chip() const
+{
+    Chip c(chip_name, chip_package);
+    apply_chip_settings(*this, c);
 /*    set<string> processed_tiles;
     for (auto tile_entry : c.tiles) {
         auto tile_db = get_tile_bitdata(TileLocator{c.info.family, c.info.name, tile_entry.second->info.type});
@@ -212,4 +279,85 @@ ChipConfig ChipConfig::from_chip(const Chip &chip)
     return cc;
 }
 
+ChipConfig ChipConfig::from_chip(const Chip &chip, TileDecodeCache &cache)
+{
+    ChipConfig cc = from_chip(chip);
+    // All-zero tiles of a type decode identically, so are found in O(1) without packing their bits
+    map<string, shared_ptr<const TileConfig>> zero_configs;
+    for (const auto &tile : chip.tiles) {
+        shared_ptr<const TileConfig> tcfg;
+        if (chip.is_tile_zero(*tile.second)) {
+            auto &zcfg = zero_configs[tile.second->info.type];
+            if (!zcfg)
+                zcfg = cache.decode(*tile.second);
+            tcfg = zcfg;
+        } else {
+            tcfg = cache.decode(*tile.second);
+        }
+        if (!tcfg->empty())
+            cc.tiles[tile.first] = *tcfg;
+    }
+    return cc;
+}
+
+// Return true if a tile has different bits set in two chips of the same device
+static bool tile_bits_differ(const Tile &tile, const Chip &a, const Chip &b)
+{
+    const TileInfo &ti = tile.info;
+    for (size_t f = ti.frame_offset; f < ti.frame_offset + ti.num_frames; f++) {
+        const char *ra = a.cram.data->at(f).data() + ti.bit_offset;
+        const char *rb = b.cram.data->at(f).data() + ti.bit_offset;
+        for (size_t i = 0; i < ti.bits_per_frame; i++)
+            if ((ra[i] != 0) != (rb[i] != 0))
+                return true;
+    }
+    return false;
+}
+
+ChipConfigUpdate ChipConfig::from_chip_incremental(const Chip &prev, ChipConfig prev_config, const Chip &chip,
+                                                   TileDecodeCache *cache)
+{
+    if (prev.info.name != chip.info.name || prev.cram.frames() != chip.cram.frames() ||
+        prev.cram.bits() != chip.cram.bits())
+        throw runtime_error("cannot incrementally decode " + chip.info.name + " against " + prev.info.name);
+    ChipConfigUpdate update;
+    update.config = from_chip(chip);
+    update.config.tiles = move(prev_config.tiles);
+    update.config.tilegroups = move(prev_config.tilegroups);
+
+    // Find the tiles covering each run of changed frames
+    vector<size_t> candidates;
+    for (int f = 0; f < chip.cram.frames(); f++) {
+        if (prev.cram.data->at(f) == chip.cram.data->at(f))
+            continue;
+        int first = f;
+        while (f + 1 < chip.cram.frames() && prev.cram.data->at(f + 1) != chip.cram.data->at(f + 1))
+            f++;
+        for (size_t id : chip.tile_index->tiles_in_frames(first, f))
+            candidates.push_back(id);
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for (size_t id : candidates) {
+        const shared_ptr<Tile> &tile = chip.indexed_tiles.at(id);
+        const TileInfo &ti = tile->info;
+        if (!tile_bits_differ(*tile, prev, chip))
+            continue;
+        update.changed_tiles.push_back(ti.name);
+        TileConfig tcfg;
+        if (cache) {
+            tcfg = *cache->decode(*tile);
+        } else {
+            auto tile_db = get_tile_bitdata(TileLocator{chip.info.family, chip.info.name, ti.type});
+            tcfg = tile_db->tile_cram_to_config(tile->cram);
+        }
+        if (tcfg.empty())
+            update.config.tiles.erase(ti.name);
+        else
+            update.config.tiles[ti.name] = tcfg;
+    }
+    return update;
+}
+
 }
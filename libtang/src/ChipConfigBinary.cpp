@@ -0,0 +1,400 @@
+#include "ChipConfigBinary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Tang {
+
+static const char binary_magic[4] = {'T', 'C', 'F', 'G'};
+
+namespace {
+// Appends varints, strings and raw bytes to an output buffer
+class BinaryWriter
+{
+public:
+    explicit BinaryWriter(string &out) : out(out)
+    {}
+
+    inline void write_varint(uint64_t val)
+    {
+        while (val >= 0x80) {
+            out.push_back(char((val & 0x7F) | 0x80));
+            val >>= 7;
+        }
+        out.push_back(char(val));
+    }
+
+    inline void write_bytes(const void *data, size_t size)
+    {
+        out.append(reinterpret_cast<const char *>(data), size);
+    }
+
+    inline void write_string(boost::string_ref str)
+    {
+        write_varint(str.size());
+        write_bytes(str.data(), str.size());
+    }
+
+private:
+    string &out;
+};
+
+// Reads back what a BinaryWriter wrote, checking every access against the end of the buffer
+class BinaryReader
+{
+public:
+    BinaryReader(const char *begin, const char *end) : pos(begin), end(end)
+    {}
+
+    inline uint64_t read_varint()
+    {
+        uint64_t val = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = uint8_t(*take(1));
+            val |= uint64_t(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return val;
+        }
+        throw runtime_error("invalid binary config: varint too long");
+    }
+
+    // Read a count or size, which cannot be more than the bytes left
+    inline size_t read_size()
+    {
+        uint64_t val = read_varint();
+        if (val > uint64_t(end - pos))
+            throw runtime_error("invalid binary config: size out of range");
+        return size_t(val);
+    }
+
+    inline const char *take(size_t size)
+    {
+        if (size_t(end - pos) < size)
+            throw runtime_error("invalid binary config: unexpected end of data");
+        const char *start = pos;
+        pos += size;
+        return start;
+    }
+
+    inline boost::string_ref read_string()
+    {
+        size_t size = read_size();
+        return boost::string_ref(take(size), size);
+    }
+
+    inline bool at_end() const
+    {
+        return pos == end;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+// Assigns indices to the symbols used by a configuration, in order of first use
+class SymbolIndex
+{
+public:
+    // Symbols are numbered densely, so indices are looked up by symbol number rather than hashed
+    SymbolIndex() : indices(Symbol::count(), UINT32_MAX)
+    {}
+
+    uint32_t get(Symbol sym)
+    {
+        if (sym.index() >= indices.size())
+            indices.resize(sym.index() + 1, UINT32_MAX);
+        uint32_t &index = indices[sym.index()];
+        if (index == UINT32_MAX) {
+            index = uint32_t(symbols.size());
+            symbols.push_back(sym);
+        }
+        return index;
+    }
+
+    void add(const TileConfig &tc)
+    {
+        for (const auto &arc : tc.carcs) {
+            get(arc.sink);
+            get(arc.source);
+        }
+        for (const auto &cw : tc.cwords)
+            get(cw.name);
+        for (const auto &ce : tc.cenums) {
+            get(ce.name);
+            get(ce.value);
+        }
+    }
+
+    vector<Symbol> symbols;
+
+private:
+    vector<uint32_t> indices;
+};
+}
+
+static void write_tile_record(BinaryWriter &bw, SymbolIndex &index, const TileConfig &tc)
+{
+    bw.write_varint(tc.carcs.size());
+    for (const auto &arc : tc.carcs) {
+        bw.write_varint(index.get(arc.sink));
+        bw.write_varint(index.get(arc.source));
+    }
+    bw.write_varint(tc.cwords.size());
+    vector<uint8_t> packed;
+    for (const auto &cw : tc.cwords) {
+        bw.write_varint(index.get(cw.name));
+        bw.write_varint(cw.value.size());
+        packed.assign((cw.value.size() + 7) / 8, 0);
+        for (size_t i = 0; i < cw.value.size(); i++)
+            if (cw.value[i])
+                packed[i / 8] |= uint8_t(1 << (i % 8));
+        bw.write_bytes(packed.data(), packed.size());
+    }
+    bw.write_varint(tc.cenums.size());
+    for (const auto &ce : tc.cenums) {
+        bw.write_varint(index.get(ce.name));
+        bw.write_varint(index.get(ce.value));
+    }
+    bw.write_varint(tc.cunknowns.size());
+    for (const auto &cu : tc.cunknowns) {
+        bw.write_varint(uint32_t(cu.frame));
+        bw.write_varint(uint32_t(cu.bit));
+    }
+}
+
+static Symbol read_symbol(BinaryReader &br, const vector<Symbol> &symbols)
+{
+    uint64_t index = br.read_varint();
+    if (index >= symbols.size())
+        throw runtime_error("invalid binary config: symbol index out of range");
+    return symbols[size_t(index)];
+}
+
+static int read_int(BinaryReader &br)
+{
+    uint64_t val = br.read_varint();
+    if (val > uint64_t(INT32_MAX))
+        throw runtime_error("invalid binary config: value out of range");
+    return int(val);
+}
+
+static void read_tile_record(BinaryReader &br, const vector<Symbol> &symbols, TileConfig &tc)
+{
+    tc.carcs.resize(br.read_size());
+    for (auto &arc : tc.carcs) {
+        arc.sink = read_symbol(br, symbols);
+        arc.source = read_symbol(br, symbols);
+    }
+    tc.cwords.resize(br.read_size());
+    for (auto &cw : tc.cwords) {
+        cw.name = read_symbol(br, symbols);
+        uint64_t bits = br.read_varint();
+        if (bits > uint64_t(INT32_MAX))
+            throw runtime_error("invalid binary config: word too long");
+        const uint8_t *packed = reinterpret_cast<const uint8_t *>(br.take(size_t((bits + 7) / 8)));
+        cw.value.resize(size_t(bits));
+        for (size_t i = 0; i < cw.value.size(); i++)
+            cw.value[i] = (packed[i / 8] >> (i % 8)) & 1;
+    }
+    tc.cenums.resize(br.read_size());
+    for (auto &ce : tc.cenums) {
+        ce.name = read_symbol(br, symbols);
+        ce.value = read_symbol(br, symbols);
+    }
+    tc.cunknowns.resize(br.read_size());
+    for (auto &cu : tc.cunknowns) {
+        cu.frame = read_int(br);
+        cu.bit = read_int(br);
+    }
+}
+
+static void write_blocks(BinaryWriter &bw, const map<uint8_t, vector<uint8_t>> &blocks)
+{
+    bw.write_varint(blocks.size());
+    for (const auto &block : blocks) {
+        bw.write_varint(block.first);
+        bw.write_varint(block.second.size());
+        bw.write_bytes(block.second.data(), block.second.size());
+    }
+}
+
+static void read_blocks(BinaryReader &br, map<uint8_t, vector<uint8_t>> &blocks)
+{
+    size_t count = br.read_size();
+    for (size_t i = 0; i < count; i++) {
+        uint64_t index = br.read_varint();
+        if (index > UINT8_MAX)
+            throw runtime_error("invalid binary config: block index out of range");
+        size_t size = br.read_size();
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(br.take(size));
+        blocks[uint8_t(index)].assign(data, data + size);
+    }
+}
+
+string BinaryChipConfig::encode(const ChipConfig &cc)
+{
+    SymbolIndex index;
+    for (const auto &tg : cc.tilegroups)
+        index.add(tg.config);
+    for (const auto &tile : cc.tiles)
+        index.add(tile.second);
+
+    string out;
+    BinaryWriter bw(out);
+    bw.write_bytes(binary_magic, sizeof(binary_magic));
+    bw.write_varint(version);
+    bw.write_varint(index.symbols.size());
+    for (Symbol sym : index.symbols)
+        bw.write_string(sym.str());
+
+    bw.write_string(cc.chip_name);
+    bw.write_string(cc.chip_package);
+    bw.write_varint(cc.metadata.size());
+    for (const auto &meta : cc.metadata)
+        bw.write_string(meta);
+    bw.write_varint(cc.sysconfig.size());
+    for (const auto &sc : cc.sysconfig) {
+        bw.write_string(sc.first);
+        bw.write_string(sc.second);
+    }
+    write_blocks(bw, cc.bram_data);
+    write_blocks(bw, cc.pll_data);
+    bw.write_varint(cc.tilegroups.size());
+    for (const auto &tg : cc.tilegroups) {
+        bw.write_varint(tg.tiles.size());
+        for (const auto &tile : tg.tiles)
+            bw.write_string(tile);
+        write_tile_record(bw, index, tg.config);
+    }
+
+    // Tile records are written separately so the directory ahead of them can hold their offsets
+    string tile_data;
+    BinaryWriter tw(tile_data);
+    bw.write_varint(cc.tiles.size());
+    for (const auto &tile : cc.tiles) {
+        size_t offset = tile_data.size();
+        write_tile_record(tw, index, tile.second);
+        bw.write_string(tile.first);
+        bw.write_varint(offset);
+        bw.write_varint(tile_data.size() - offset);
+    }
+    bw.write_varint(tile_data.size());
+    out += tile_data;
+    return out;
+}
+
+bool BinaryChipConfig::is_binary(const char *begin, const char *end)
+{
+    return size_t(end - begin) >= sizeof(binary_magic) && memcmp(begin, binary_magic, sizeof(binary_magic)) == 0;
+}
+
+BinaryChipConfig::BinaryChipConfig(const char *begin, const char *end)
+{
+    if (!is_binary(begin, end))
+        throw runtime_error("not a binary config");
+    BinaryReader br(begin + sizeof(binary_magic), end);
+    uint64_t file_version = br.read_varint();
+    if (file_version != version)
+        throw runtime_error("unsupported binary config version " + std::to_string(file_version));
+    symbols.resize(br.read_size());
+    for (auto &sym : symbols)
+        sym = Symbol(br.read_string());
+
+    header.chip_name = br.read_string().to_string();
+    header.chip_package = br.read_string().to_string();
+    header.metadata.resize(br.read_size());
+    for (auto &meta : header.metadata)
+        meta = br.read_string().to_string();
+    size_t sysconfig_count = br.read_size();
+    for (size_t i = 0; i < sysconfig_count; i++) {
+        string key = br.read_string().to_string();
+        header.sysconfig[key] = br.read_string().to_string();
+    }
+    read_blocks(br, header.bram_data);
+    read_blocks(br, header.pll_data);
+    header.tilegroups.resize(br.read_size());
+    for (auto &tg : header.tilegroups) {
+        tg.tiles.resize(br.read_size());
+        for (auto &tile : tg.tiles)
+            tile = br.read_string().to_string();
+        read_tile_record(br, symbols, tg.config);
+    }
+
+    struct DirectoryEntry
+    {
+        boost::string_ref name;
+        size_t offset, size;
+    };
+    vector<DirectoryEntry> directory(br.read_size());
+    for (auto &entry : directory) {
+        entry.name = br.read_string();
+        entry.offset = br.read_size();
+        entry.size = br.read_size();
+    }
+    size_t tile_data_size = br.read_size();
+    const char *tile_data = br.take(tile_data_size);
+    if (!br.at_end())
+        throw runtime_error("invalid binary config: trailing data");
+    tiles.reserve(directory.size());
+    for (const auto &entry : directory) {
+        if (entry.offset > tile_data_size || entry.size > tile_data_size - entry.offset)
+            throw runtime_error("invalid binary config: tile " + entry.name.to_string() + " out of range");
+        if (!tiles.empty() && !(tiles.back().name < entry.name))
+            throw runtime_error("invalid binary config: tile directory out of order");
+        const char *tile_begin = tile_data + entry.offset;
+        tiles.push_back(TileEntry{entry.name, tile_begin, tile_begin + entry.size});
+    }
+}
+
+const BinaryChipConfig::TileEntry *BinaryChipConfig::find_tile(const string &name) const
+{
+    boost::string_ref key(name);
+    auto found = lower_bound(tiles.begin(), tiles.end(), key,
+                             [](const TileEntry &entry, boost::string_ref k) { return entry.name < k; });
+    if (found == tiles.end() || found->name != key)
+        return nullptr;
+    return &*found;
+}
+
+vector<string> BinaryChipConfig::tile_names() const
+{
+    vector<string> result;
+    result.reserve(tiles.size());
+    for (const auto &entry : tiles)
+        result.push_back(entry.name.to_string());
+    return result;
+}
+
+bool BinaryChipConfig::has_tile(const string &name) const
+{
+    return find_tile(name) != nullptr;
+}
+
+TileConfig BinaryChipConfig::read_tile(const string &name) const
+{
+    const TileEntry *entry = find_tile(name);
+    if (entry == nullptr)
+        throw out_of_range("no configuration for tile " + name);
+    BinaryReader br(entry->begin, entry->end);
+    TileConfig tc;
+    read_tile_record(br, symbols, tc);
+    if (!br.at_end())
+        throw runtime_error("invalid binary config: trailing data in tile " + name);
+    return tc;
+}
+
+ChipConfig BinaryChipConfig::decode() const
+{
+    ChipConfig cc = header;
+    for (const auto &entry : tiles) {
+        BinaryReader br(entry.begin, entry.end);
+        auto tile = cc.tiles.emplace_hint(cc.tiles.end(), entry.name.to_string(), TileConfig());
+        read_tile_record(br, symbols, tile->second);
+        if (!br.at_end())
+            throw runtime_error("invalid binary config: trailing data in tile " + entry.name.to_string());
+    }
+    return cc;
+}
+
+}
@@ -3,12 +3,21 @@
 #include "Tile.hpp"
 #include "Util.hpp"
 #include "BitDatabase.hpp"
+#include "TileIndex.hpp"
+#include "Metrics.hpp"
 #include <iostream>
 #include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <stdexcept>
 #include <mutex>
+#include <set>
+#include <algorithm>
+#ifndef NO_THREADS
+#include <thread>
+#include <atomic>
+#include <exception>
+#endif
 
 
 
@@ -25,6 +34,7 @@ static mutex tilegrid_cache_mutex;
 #endif
 
 void load_database(string root) {
+    PhaseTimer timer(Phase::DATABASE_LOAD);
     db_root = root;
     pt::read_json(root + "/" + "devices.json", devices_info);
 }
@@ -99,6 +109,7 @@ ChipInfo get_chip_info(const DeviceLocator &part) {
 }
 
 vector<TileInfo> get_device_tilegrid(const DeviceLocator &part) {
+    PhaseTimer timer(Phase::TILEGRID_LOAD);
     vector <TileInfo> tilesInfo;
     assert(db_root != "");
     string tilegrid_path = db_root + "/" + part.family + "/" + part.device + "/tilegrid.json";
@@ -139,26 +150,135 @@ vector<TileInfo> get_device_tilegrid(const DeviceLocator &part) {
     return tilesInfo;
 }
 
+// Cache tile indexes, keyed by device. As with BitDatabases below, each device has its own slot, so building one
+// index does not hold up lookups or builds for other devices
+struct TileIndexSlot {
+#ifndef NO_THREADS
+    mutex load_mutex;
+#endif
+    shared_ptr<const TileIndex> index;
+};
+
+static map<string, shared_ptr<TileIndexSlot>> tile_index_cache;
+#ifndef NO_THREADS
+static mutex tile_index_cache_mutex;
+#endif
+
+// Return the index for a device, building it from the given tilegrid, or loading the tilegrid if none is given
+static shared_ptr<const TileIndex> find_tile_index(const DeviceLocator &part, const vector<TileInfo> *tilegrid) {
+    shared_ptr<TileIndexSlot> slot;
+    {
+#ifndef NO_THREADS
+        lock_guard <mutex> lock(tile_index_cache_mutex);
+#endif
+        shared_ptr<TileIndexSlot> &entry = tile_index_cache[part.device];
+        if (!entry)
+            entry = make_shared<TileIndexSlot>();
+        slot = entry;
+    }
+#ifndef NO_THREADS
+    lock_guard <mutex> slot_lock(slot->load_mutex);
+#endif
+    if (!slot->index) {
+        ChipInfo info = get_chip_info(part);
+        if (tilegrid != nullptr)
+            slot->index = make_shared<const TileIndex>(*tilegrid, info.num_frames);
+        else
+            slot->index = make_shared<const TileIndex>(get_device_tilegrid(part), info.num_frames);
+    }
+    return slot->index;
+}
+
+shared_ptr<const TileIndex> get_device_tile_index(const DeviceLocator &part) {
+    return find_tile_index(part, nullptr);
+}
+
+shared_ptr<const TileIndex> get_device_tile_index(const DeviceLocator &part, const vector<TileInfo> &tilegrid) {
+    return find_tile_index(part, &tilegrid);
+}
 
-static unordered_map<TileLocator, shared_ptr<TileBitDatabase>> bitdb_store;
+// Each locator has its own slot, so loading one database does not hold up lookups or loads of other tile types
+struct BitDatabaseSlot {
+#ifndef NO_THREADS
+    mutex load_mutex;
+#endif
+    shared_ptr<TileBitDatabase> bitdb;
+};
+
+static unordered_map<TileLocator, shared_ptr<BitDatabaseSlot>> bitdb_store;
 #ifndef NO_THREADS
 static mutex bitdb_store_mutex;
 #endif
 
 shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile) {
 #ifndef NO_THREADS
-    lock_guard <mutex> bitdb_store_lg(bitdb_store_mutex);
+    // Loaded databases are never removed from the store, so each thread can remember the ones it has seen and find
+    // them again without taking any lock
+    thread_local unordered_map<TileLocator, shared_ptr<TileBitDatabase>> seen;
+    auto found = seen.find(tile);
+    if (found != seen.end())
+        return found->second;
+#endif
+    shared_ptr<BitDatabaseSlot> slot;
+    {
+#ifndef NO_THREADS
+        lock_guard <mutex> bitdb_store_lg(bitdb_store_mutex);
 #endif
-    if (bitdb_store.find(tile) == bitdb_store.end()) {
+        shared_ptr<BitDatabaseSlot> &entry = bitdb_store[tile];
+        if (!entry)
+            entry = make_shared<BitDatabaseSlot>();
+        slot = entry;
+    }
+#ifndef NO_THREADS
+    lock_guard <mutex> slot_lg(slot->load_mutex);
+#endif
+    if (!slot->bitdb) {
+        PhaseTimer timer(Phase::DATABASE_LOAD);
         assert(!db_root.empty());
         string bitdb_path = db_root + "/" + tile.family + "/tiledata/" + tile.tiletype + "/bits.db";
-        shared_ptr <TileBitDatabase> bitdb{new TileBitDatabase(bitdb_path)};
-        bitdb_store[tile] = bitdb;
-        return bitdb;
-    } else {
-        return bitdb_store.at(tile);
+        slot->bitdb = shared_ptr<TileBitDatabase>{new TileBitDatabase(bitdb_path)};
     }
+#ifndef NO_THREADS
+    seen[tile] = slot->bitdb;
+#endif
+    return slot->bitdb;
 }
 
+void preload_device_databases(const DeviceLocator &part) {
+    set<string> tiletypes;
+    for (const auto &tile : get_device_tilegrid(part))
+        tiletypes.insert(tile.type);
+    vector<TileLocator> locators;
+    for (const auto &type : tiletypes)
+        locators.push_back(TileLocator(part.family, part.device, type));
+#ifdef NO_THREADS
+    for (const auto &loc : locators)
+        get_tile_bitdata(loc);
+#else
+    // Workers take the next unloaded tile type until all are done; the first error is passed on to the caller
+    size_t num_workers = min<size_t>(max(thread::hardware_concurrency(), 1u), locators.size());
+    atomic<size_t> next{0};
+    exception_ptr error;
+    mutex error_mutex;
+    vector<thread> workers;
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.emplace_back([&]() {
+            for (size_t idx = next++; idx < locators.size(); idx = next++) {
+                try {
+                    get_tile_bitdata(locators.at(idx));
+                } catch (...) {
+                    lock_guard <mutex> error_lg(error_mutex);
+                    if (!error)
+                        error = current_exception();
+                }
+            }
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    if (error)
+        rethrow_exception(error);
+#endif
+}
 
 }
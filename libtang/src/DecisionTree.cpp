@@ -0,0 +1,130 @@
+#include "DecisionTree.hpp"
+#include "BitDatabase.hpp"
+#include "CRAM.hpp"
+#include <algorithm>
+
+namespace Tang {
+
+// Sets of candidates this small are matched in full rather than split further
+static const size_t leaf_candidates_max = 4;
+// Limits on the size of a tree, which can grow quickly when few bits tell the candidates apart
+static const int depth_max = 12;
+static const size_t nodes_per_candidate = 4;
+
+DecisionTree::DecisionTree(const vector<const BitGroup *> &candidates) : groups(candidates)
+{
+    vector<uint32_t> cands(candidates.size());
+    for (size_t i = 0; i < cands.size(); i++)
+        cands[i] = uint32_t(i);
+    vector<pair<int, int>> tested;
+    build(cands, tested, 0);
+}
+
+uint32_t DecisionTree::add_leaf(const vector<uint32_t> &cands)
+{
+    uint32_t start = uint32_t(leaf_candidates.size());
+    leaf_candidates.insert(leaf_candidates.end(), cands.begin(), cands.end());
+    nodes.push_back(Node{-1, -1, {start, uint32_t(leaf_candidates.size())}});
+    return uint32_t(nodes.size() - 1);
+}
+
+uint32_t DecisionTree::build(const vector<uint32_t> &cands, vector<pair<int, int>> &tested, int depth)
+{
+    if (cands.size() <= leaf_candidates_max || depth >= depth_max ||
+        nodes.size() + 2 > nodes_per_candidate * groups.size())
+        return add_leaf(cands);
+
+    // All the bits the remaining candidates depend on, not already tested on the way here
+    vector<ConfigBit> used;
+    for (uint32_t c : cands)
+        for (const auto &b : groups[c]->bits)
+            if (find(tested.begin(), tested.end(), make_pair(b.frame, b.bit)) == tested.end())
+                used.push_back(b);
+    if (used.empty())
+        return add_leaf(cands);
+    sort(used.begin(), used.end());
+
+    // A candidate reaches the branch for a value unless it needs the other value. Choose the bit that sends the
+    // fewest candidates down both branches, then the most even split, preferring the lowest bit for repeatability
+    size_t best_total = 2 * cands.size(), best_max = cands.size();
+    ConfigBit best{-1, -1};
+    for (size_t i = 0; i < used.size();) {
+        size_t j = i, need0 = 0, need1 = 0;
+        for (; j < used.size() && used[j].frame == used[i].frame && used[j].bit == used[i].bit; j++)
+            (used[j].inv ? need0 : need1)++;
+        size_t size0 = cands.size() - need1, size1 = cands.size() - need0;
+        if (size0 + size1 < best_total || (size0 + size1 == best_total && max(size0, size1) < best_max)) {
+            best_total = size0 + size1;
+            best_max = max(size0, size1);
+            best = ConfigBit{used[i].frame, used[i].bit};
+        }
+        i = j;
+    }
+    // Testing a bit only pays for itself if it rules out at least two candidates on average
+    if (best.frame < 0 || best_total + 2 > 2 * cands.size())
+        return add_leaf(cands);
+
+    vector<uint32_t> branch[2];
+    for (uint32_t c : cands) {
+        bool need0 = false, need1 = false;
+        for (const auto &b : groups[c]->bits) {
+            if (b.frame == best.frame && b.bit == best.bit)
+                (b.inv ? need0 : need1) = true;
+        }
+        if (!need1)
+            branch[0].push_back(c);
+        if (!need0)
+            branch[1].push_back(c);
+    }
+
+    uint32_t node = uint32_t(nodes.size());
+    nodes.push_back(Node{best.frame, best.bit, {0, 0}});
+    tested.push_back(make_pair(best.frame, best.bit));
+    for (int value = 0; value < 2; value++) {
+        uint32_t next = build(branch[value], tested, depth + 1);
+        nodes[node].next[value] = next;
+    }
+    tested.pop_back();
+    return node;
+}
+
+static inline bool tile_bit(const CRAMView &tile, int frame, int bit)
+{
+    return tile.get_bit(frame, bit);
+}
+
+static inline bool tile_bit(const PackedCRAM &tile, int frame, int bit)
+{
+    return tile.get_bit(frame, bit);
+}
+
+template <typename TileT> int DecisionTree::walk(const TileT &tile) const
+{
+    if (nodes.empty())
+        return -1;
+    const Node *node = &nodes.front();
+    while (node->frame >= 0)
+        node = &nodes[node->next[tile_bit(tile, node->frame, node->bit) ? 1 : 0]];
+    for (uint32_t i = node->next[0]; i < node->next[1]; i++) {
+        if (groups[leaf_candidates[i]]->match(tile))
+            return int(leaf_candidates[i]);
+    }
+    return -1;
+}
+
+int DecisionTree::first_match(const CRAMView &tile) const
+{
+    return walk(tile);
+}
+
+int DecisionTree::first_match(const PackedCRAM &tile) const
+{
+    return walk(tile);
+}
+
+size_t DecisionTree::size() const
+{
+    return nodes.size();
+}
+
+}
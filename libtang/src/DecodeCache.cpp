@@ -0,0 +1,106 @@
+#include "DecodeCache.hpp"
+#include "BitDatabase.hpp"
+#include "TileConfig.hpp"
+#include "Tile.hpp"
+#include "Metrics.hpp"
+
+namespace Tang {
+
+TileDecodeCache::TileDecodeCache(size_t max_entries) : max_entries(max_entries)
+{}
+
+shared_ptr<const TileConfig> TileDecodeCache::decode(const Tile &tile)
+{
+    return decode(TileLocator(tile.info.family, tile.info.device, tile.info.type), tile.cram);
+}
+
+shared_ptr<const TileConfig> TileDecodeCache::decode(const TileLocator &loc, const CRAMView &cram)
+{
+    Entry entry;
+    cram.pack(entry.bits);
+    entry.key = Key{loc, entry.bits.hash()};
+    {
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(cache_mutex);
+#endif
+        auto found = index.find(entry.key);
+        // A full compare rules out hash collisions, which are then treated as a miss
+        if (found != index.end() && found->second->bits == entry.bits) {
+            ++hit_count;
+            Metrics::add(Counter::TILE_CACHE_HITS);
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->config;
+        }
+        ++miss_count;
+        Metrics::add(Counter::TILE_CACHE_MISSES);
+    }
+    // Decode outside the lock, so other threads can still hit while this tile is being decoded
+    entry.config = make_shared<const TileConfig>(get_tile_bitdata(loc)->tile_cram_to_config(cram));
+    shared_ptr<const TileConfig> result = entry.config;
+    if (max_entries == 0)
+        return result;
+    {
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(cache_mutex);
+#endif
+        auto found = index.find(entry.key);
+        if (found != index.end()) {
+            // Another thread got here first, or a collision; either way the newest entry wins
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        entries.push_front(std::move(entry));
+        index[entries.front().key] = entries.begin();
+        while (entries.size() > max_entries) {
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+    return result;
+}
+
+size_t TileDecodeCache::hits() const
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(cache_mutex);
+#endif
+    return hit_count;
+}
+
+size_t TileDecodeCache::misses() const
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(cache_mutex);
+#endif
+    return miss_count;
+}
+
+double TileDecodeCache::hit_rate() const
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(cache_mutex);
+#endif
+    size_t total = hit_count + miss_count;
+    return total == 0 ? 0.0 : double(hit_count) / double(total);
+}
+
+size_t TileDecodeCache::size() const
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(cache_mutex);
+#endif
+    return entries.size();
+}
+
+void TileDecodeCache::clear()
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(cache_mutex);
+#endif
+    index.clear();
+    entries.clear();
+    hit_count = 0;
+    miss_count = 0;
+}
+
+}
@@ -0,0 +1,126 @@
+#include "HexCodec.hpp"
+#include <stdexcept>
+
+namespace Tang {
+
+namespace {
+// Lookup tables, so that neither direction needs a branch per digit
+struct HexTables
+{
+    // The two digits of every byte value
+    char pairs[256][2];
+    // The value of every character, or 0xFF if it is not a hex digit
+    uint8_t nibbles[256];
+
+    HexTables()
+    {
+        const char *digits = "0123456789abcdef";
+        for (int i = 0; i < 256; i++) {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0xF];
+            nibbles[i] = 0xFF;
+        }
+        for (int i = 0; i < 10; i++)
+            nibbles['0' + i] = uint8_t(i);
+        for (int i = 0; i < 6; i++) {
+            nibbles['a' + i] = uint8_t(10 + i);
+            nibbles['A' + i] = uint8_t(10 + i);
+        }
+    }
+};
+
+const HexTables &hex_tables()
+{
+    static const HexTables tables;
+    return tables;
+}
+
+// Bytes in a canonical .bram_init line, and its length in characters including the newline
+const size_t line_bytes = 32;
+const size_t line_chars = line_bytes * 3;
+
+inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+}
+
+void append_hex(string &out, const uint8_t *data, size_t size)
+{
+    const HexTables &tables = hex_tables();
+    size_t start = out.size();
+    out.resize(start + size * 2);
+    char *p = &out[start];
+    for (size_t i = 0; i < size; i++, p += 2) {
+        p[0] = tables.pairs[data[i]][0];
+        p[1] = tables.pairs[data[i]][1];
+    }
+}
+
+void append_hex_lines(string &out, const uint8_t *data, size_t size, size_t bytes_per_line)
+{
+    const HexTables &tables = hex_tables();
+    size_t start = out.size();
+    out.resize(start + size * 3);
+    char *p = &out[start];
+    for (size_t i = 0; i < size; i++, p += 3) {
+        p[0] = tables.pairs[data[i]][0];
+        p[1] = tables.pairs[data[i]][1];
+        p[2] = (i % bytes_per_line == bytes_per_line - 1) ? '\n' : ' ';
+    }
+}
+
+// Decode a canonical line, returning false without writing anything if the line is not one
+static bool decode_hex_line(const char *p, vector<uint8_t> &out)
+{
+    const uint8_t *nibbles = hex_tables().nibbles;
+    uint8_t bytes[line_bytes];
+    // Check the whole line at once rather than branching on every character
+    uint8_t invalid = 0;
+    bool separators = true;
+    for (size_t i = 0; i < line_bytes; i++) {
+        uint8_t hi = nibbles[uint8_t(p[3 * i])], lo = nibbles[uint8_t(p[3 * i + 1])];
+        invalid |= hi | lo;
+        separators &= (p[3 * i + 2] == ((i == line_bytes - 1) ? '\n' : ' '));
+        bytes[i] = uint8_t((hi << 4) | (lo & 0xF));
+    }
+    if ((invalid & 0xF0) || !separators)
+        return false;
+    out.insert(out.end(), bytes, bytes + line_bytes);
+    return true;
+}
+
+const char *decode_hex_record(const char *begin, const char *end, vector<uint8_t> &out)
+{
+    const uint8_t *nibbles = hex_tables().nibbles;
+    const char *p = begin;
+    while (true) {
+        while (p != end && is_blank(*p))
+            ++p;
+        if (p == end || *p == '.')
+            return p;
+        if (*p == '#') {
+            while (p != end && *p != '\n')
+                ++p;
+            continue;
+        }
+        if (size_t(end - p) >= line_chars && decode_hex_line(p, out)) {
+            p += line_chars;
+            continue;
+        }
+        // Anything else is decoded a token at a time
+        const char *tok = p;
+        while (p != end && !is_blank(*p))
+            ++p;
+        if ((p - tok) % 2 != 0)
+            throw runtime_error("invalid hex data " + string(tok, p));
+        for (const char *d = tok; d != p; d += 2) {
+            uint8_t hi = nibbles[uint8_t(d[0])], lo = nibbles[uint8_t(d[1])];
+            if ((hi | lo) & 0xF0)
+                throw runtime_error("invalid hex data " + string(tok, p));
+            out.push_back(uint8_t((hi << 4) | lo));
+        }
+    }
+}
+
+}
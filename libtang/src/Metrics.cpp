@@ -0,0 +1,103 @@
+#include "Metrics.hpp"
+#include <sstream>
+#include <iomanip>
+
+namespace Tang {
+
+bool Metrics::is_enabled = false;
+chrono::steady_clock::time_point Metrics::enable_time;
+Metrics::value_t Metrics::counters[size_t(Counter::NUM_COUNTERS)];
+Metrics::value_t Metrics::phase_ns[size_t(Phase::NUM_PHASES)];
+Metrics::value_t Metrics::phase_count[size_t(Phase::NUM_PHASES)];
+
+static const char *phase_names[] = {
+        "database_load", "tilegrid_load", "chip_construction", "block_parse", "crc", "unpack", "tile_decode",
+        "tile_encode", "serialise", "write",
+};
+
+static const char *counter_names[] = {
+        "bytes_read", "bytes_written", "frames_read", "frames_written", "tiles_decoded", "tiles_encoded",
+        "tile_cache_hits", "tile_cache_misses", "pack_cache_hits", "pack_cache_misses", "allocations",
+};
+
+static_assert(sizeof(phase_names) / sizeof(phase_names[0]) == size_t(Phase::NUM_PHASES), "missing phase name");
+static_assert(sizeof(counter_names) / sizeof(counter_names[0]) == size_t(Counter::NUM_COUNTERS),
+              "missing counter name");
+
+void Metrics::enable(bool on)
+{
+    if (on && !is_enabled)
+        enable_time = chrono::steady_clock::now();
+    is_enabled = on;
+}
+
+void Metrics::add_time(Phase phase, chrono::steady_clock::duration time)
+{
+    phase_ns[size_t(phase)] += uint64_t(chrono::duration_cast<chrono::nanoseconds>(time).count());
+    phase_count[size_t(phase)] += 1;
+}
+
+uint64_t Metrics::count(Counter counter)
+{
+    return counters[size_t(counter)];
+}
+
+uint64_t Metrics::phase_calls(Phase phase)
+{
+    return phase_count[size_t(phase)];
+}
+
+double Metrics::phase_seconds(Phase phase)
+{
+    return double(phase_ns[size_t(phase)]) / 1e9;
+}
+
+void Metrics::reset()
+{
+    for (auto &c : counters)
+        c = 0;
+    for (size_t i = 0; i < size_t(Phase::NUM_PHASES); i++) {
+        phase_ns[i] = 0;
+        phase_count[i] = 0;
+    }
+    enable_time = chrono::steady_clock::now();
+}
+
+const char *Metrics::name(Phase phase)
+{
+    return phase_names[size_t(phase)];
+}
+
+const char *Metrics::name(Counter counter)
+{
+    return counter_names[size_t(counter)];
+}
+
+string Metrics::report(bool json)
+{
+    double elapsed = is_enabled ? chrono::duration<double>(chrono::steady_clock::now() - enable_time).count() : 0;
+    ostringstream out;
+    out << fixed << setprecision(6);
+    if (json) {
+        out << "{\"elapsed_seconds\": " << elapsed << ", \"phases\": {";
+        for (size_t i = 0; i < size_t(Phase::NUM_PHASES); i++)
+            out << (i ? ", " : "") << "\"" << phase_names[i] << "\": {\"calls\": " << phase_calls(Phase(i))
+                << ", \"seconds\": " << phase_seconds(Phase(i)) << "}";
+        out << "}, \"counters\": {";
+        for (size_t i = 0; i < size_t(Counter::NUM_COUNTERS); i++)
+            out << (i ? ", " : "") << "\"" << counter_names[i] << "\": " << count(Counter(i));
+        out << "}}" << endl;
+    } else {
+        out << left << setw(20) << "phase" << right << setw(12) << "calls" << setw(14) << "seconds" << endl;
+        for (size_t i = 0; i < size_t(Phase::NUM_PHASES); i++)
+            out << left << setw(20) << phase_names[i] << right << setw(12) << phase_calls(Phase(i)) << setw(14)
+                << phase_seconds(Phase(i)) << endl;
+        out << left << setw(20) << "elapsed" << right << setw(12) << "" << setw(14) << elapsed << endl << endl;
+        out << left << setw(20) << "counter" << right << setw(26) << "value" << endl;
+        for (size_t i = 0; i < size_t(Counter::NUM_COUNTERS); i++)
+            out << left << setw(20) << counter_names[i] << right << setw(26) << count(Counter(i)) << endl;
+    }
+    return out.str();
+}
+
+}
@@ -0,0 +1,141 @@
+#include "PackCache.hpp"
+#include "Bitstream.hpp"
+#include "Chip.hpp"
+#include "Scanner.hpp"
+#include "Metrics.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace Tang {
+
+static const char cache_magic[4] = {'T', 'P', 'K', 'C'};
+
+static void put_uint32(string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(char((value >> (8 * i)) & 0xff));
+}
+
+static uint32_t get_uint32(const char *in)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= uint32_t(uint8_t(in[i])) << (8 * i);
+    return value;
+}
+
+// A frame block is its size, the packed frame, the CRC and four bytes of padding
+size_t PackCache::block_bytes() const
+{
+    return 2 + frame_bytes + 2 + 4;
+}
+
+void PackCache::clear()
+{
+    num_frames = 0;
+    frame_bytes = 0;
+    frames.clear();
+}
+
+bool PackCache::load(const string &filename)
+{
+    clear();
+    string buf;
+    if (!read_file(filename, buf))
+        return false;
+    const size_t header_size = sizeof(cache_magic) + 3 * 4;
+    if (buf.size() < header_size || memcmp(buf.data(), cache_magic, sizeof(cache_magic)) != 0)
+        return false;
+    const char *ptr = buf.data() + sizeof(cache_magic);
+    if (get_uint32(ptr) != version)
+        return false;
+    num_frames = get_uint32(ptr + 4);
+    frame_bytes = get_uint32(ptr + 8);
+    if (buf.size() - header_size != size_t(num_frames) * block_bytes()) {
+        clear();
+        return false;
+    }
+    frames.assign(buf.begin() + header_size, buf.end());
+    // Blocks are only trusted if they are shaped like the frame blocks pack writes
+    for (uint32_t idx = 0; idx < num_frames; idx++) {
+        const uint8_t *block = frames.data() + idx * block_bytes();
+        uint16_t size = uint16_t((block[0] << 8) | block[1]);
+        const char *padding = reinterpret_cast<const char *>(block) + block_bytes() - 4;
+        if (size != uint16_t((block_bytes() - 2) << 3) || get_uint32(padding) != 0) {
+            clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void PackCache::save(const string &filename) const
+{
+    string header(cache_magic, sizeof(cache_magic));
+    put_uint32(header, version);
+    put_uint32(header, num_frames);
+    put_uint32(header, frame_bytes);
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("failed to open cache file " + filename + " for writing");
+    out.write(header.data(), header.size());
+    out.write(reinterpret_cast<const char *>(frames.data()), frames.size());
+    if (!out)
+        throw runtime_error("failed to write cache file " + filename);
+}
+
+string PackCache::pack(const Chip &chip)
+{
+    PhaseTimer timer(Phase::SERIALISE);
+    reused_count = 0;
+    encoded_count = 0;
+    if (num_frames != uint32_t(chip.cram.frames()) || frame_bytes != uint32_t(chip.cram.bits() / 8)) {
+        num_frames = uint32_t(chip.cram.frames());
+        frame_bytes = uint32_t(chip.cram.bits() / 8);
+        // A size of zero marks blocks that have never been encoded
+        frames.assign(size_t(num_frames) * block_bytes(), 0);
+    }
+    vector<uint8_t> packed(frame_bytes);
+    for (uint32_t idx = 0; idx < num_frames; idx++) {
+        uint8_t *block = frames.data() + idx * block_bytes();
+        Bitstream::pack_frame(chip, int(idx), packed.data());
+        if ((block[0] != 0 || block[1] != 0) && memcmp(block + 2, packed.data(), frame_bytes) == 0) {
+            ++reused_count;
+            continue;
+        }
+        vector<uint8_t> encoded = Bitstream::serialise_frame(chip, int(idx));
+        if (encoded.size() != block_bytes())
+            throw runtime_error("unexpected frame block size while packing");
+        memcpy(block, encoded.data(), encoded.size());
+        ++encoded_count;
+    }
+
+    string result;
+    for (const auto &str : chip.metadata) {
+        result += str;
+        result.push_back(0x0a);
+    }
+    vector<uint8_t> header = Bitstream::serialise_header(chip);
+    vector<uint8_t> trailer = Bitstream::serialise_trailer();
+    result.reserve(result.size() + header.size() + frames.size() + trailer.size());
+    result.append(header.begin(), header.end());
+    result.append(frames.begin(), frames.end());
+    result.append(trailer.begin(), trailer.end());
+    Metrics::add(Counter::FRAMES_WRITTEN, num_frames);
+    Metrics::add(Counter::PACK_CACHE_HITS, reused_count);
+    Metrics::add(Counter::PACK_CACHE_MISSES, encoded_count);
+    return result;
+}
+
+size_t PackCache::frames_reused() const
+{
+    return reused_count;
+}
+
+size_t PackCache::frames_encoded() const
+{
+    return encoded_count;
+}
+
+}
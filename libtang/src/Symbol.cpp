@@ -0,0 +1,142 @@
+#include "Symbol.hpp"
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
+#include <stdexcept>
+#ifndef NO_THREADS
+#include <atomic>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/shared_lock_guard.hpp>
+#include <boost/thread/lock_guard.hpp>
+#endif
+
+namespace Tang {
+
+namespace {
+// Names are stored in fixed size chunks that never move, so a name can be read without locking while others are
+// being added
+const uint32_t chunk_bits = 12;
+const uint32_t chunk_size = 1u << chunk_bits;
+const uint32_t max_chunks = 1u << 16;
+
+struct NameHash
+{
+    size_t operator()(boost::string_ref s) const
+    {
+        return boost::hash_range(s.begin(), s.end());
+    }
+};
+
+struct SymbolTable
+{
+#ifdef NO_THREADS
+    string *chunks[max_chunks];
+#else
+    atomic<string *> chunks[max_chunks];
+    boost::shared_mutex mutex;
+#endif
+    uint32_t count = 0;
+    // Keys refer to the stored names
+    unordered_map<boost::string_ref, uint32_t, NameHash> ids;
+
+    SymbolTable()
+    {
+        for (auto &chunk : chunks)
+            chunk = nullptr;
+        add("");
+    }
+
+    // Must be called with the table locked for writing
+    uint32_t add(boost::string_ref name)
+    {
+        if ((count >> chunk_bits) >= max_chunks)
+            throw runtime_error("symbol table full");
+        string *chunk = chunks[count >> chunk_bits];
+        if (chunk == nullptr) {
+            chunk = new string[chunk_size];
+            chunks[count >> chunk_bits] = chunk;
+        }
+        string &stored = chunk[count & (chunk_size - 1)];
+        stored.assign(name.begin(), name.end());
+        ids[boost::string_ref(stored)] = count;
+        return count++;
+    }
+};
+
+SymbolTable &symbol_table()
+{
+    static SymbolTable table;
+    return table;
+}
+}
+
+Symbol::Symbol(const string &name) : Symbol(boost::string_ref(name))
+{}
+
+Symbol::Symbol(const char *name) : Symbol(boost::string_ref(name))
+{}
+
+Symbol::Symbol(boost::string_ref name)
+{
+    SymbolTable &table = symbol_table();
+    {
+#ifndef NO_THREADS
+        boost::shared_lock_guard<boost::shared_mutex> guard(table.mutex);
+#endif
+        auto found = table.ids.find(name);
+        if (found != table.ids.end()) {
+            id = found->second;
+            return;
+        }
+    }
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(table.mutex);
+#endif
+    // Another thread may have added the name in the meantime
+    auto found = table.ids.find(name);
+    id = (found != table.ids.end()) ? found->second : table.add(name);
+}
+
+boost::optional<Symbol> Symbol::find(const string &name)
+{
+    SymbolTable &table = symbol_table();
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(table.mutex);
+#endif
+    auto found = table.ids.find(name);
+    if (found == table.ids.end())
+        return boost::optional<Symbol>();
+    Symbol sym;
+    sym.id = found->second;
+    return sym;
+}
+
+size_t Symbol::count()
+{
+    SymbolTable &table = symbol_table();
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(table.mutex);
+#endif
+    return table.count;
+}
+
+const string &Symbol::str() const
+{
+    const string *chunk = symbol_table().chunks[id >> chunk_bits];
+    return chunk[id & (chunk_size - 1)];
+}
+
+ostream &operator<<(ostream &out, const Symbol &sym)
+{
+    out << sym.str();
+    return out;
+}
+
+istream &operator>>(istream &in, Symbol &sym)
+{
+    string name;
+    in >> name;
+    sym = Symbol(name);
+    return in;
+}
+
+}
@@ -0,0 +1,231 @@
+#include "Synthetic.hpp"
+#include "BitDatabase.hpp"
+#include "Bitstream.hpp"
+#include "Tile.hpp"
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <stdexcept>
+#include <climits>
+
+namespace pt = boost::property_tree;
+namespace fs = boost::filesystem;
+
+namespace Tang {
+
+// Fill a tile with a random selection of the settings in a database
+static void random_settings(const FrozenTileBitDatabase &db, mt19937_64 &rng, CRAMView &tile)
+{
+    for (const auto *mux : db.get_muxes()) {
+        if (rng() % 3 != 0 || mux->arcs.empty())
+            continue;
+        auto arc = mux->arcs.begin();
+        advance(arc, rng() % mux->arcs.size());
+        arc->second.bits.set_group(tile);
+    }
+    for (const auto *word : db.get_words()) {
+        for (const auto &bits : word->bits) {
+            if (rng() % 2 == 0)
+                bits.set_group(tile);
+        }
+    }
+    for (const auto *senum : db.get_enums()) {
+        if (rng() % 2 != 0 || senum->options.empty())
+            continue;
+        auto opt = senum->options.begin();
+        advance(opt, rng() % senum->options.size());
+        opt->second.set_group(tile);
+    }
+}
+
+static vector<uint8_t> random_payload(mt19937_64 &rng, size_t size)
+{
+    vector<uint8_t> payload(size);
+    for (auto &b : payload)
+        b = uint8_t(rng());
+    return payload;
+}
+
+SyntheticGenerator::SyntheticGenerator(const DeviceLocator &device, const SyntheticOptions &options)
+        : options(options), chip(get_chip_info(device))
+{
+    if (options.content == SyntheticContent::STRUCTURED) {
+        for (const auto &tile : chip.indexed_tiles) {
+            if (!tile_dbs.count(tile->info.type))
+                tile_dbs[tile->info.type] =
+                        get_tile_bitdata(TileLocator(device.family, device.device, tile->info.type))->freeze();
+        }
+    }
+    header_bytes = Bitstream::serialise_header(chip).size();
+}
+
+const Chip &SyntheticGenerator::make_chip(uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    int frames = chip.cram.frames(), bits = chip.cram.bits();
+    vector<vector<char>> &data = *chip.cram.data;
+    for (auto &row : data)
+        fill(row.begin(), row.end(), 0);
+    switch (options.content) {
+    case SyntheticContent::EMPTY:
+        break;
+    case SyntheticContent::SPARSE: {
+        auto count = uint64_t(options.density * frames * bits);
+        for (uint64_t i = 0; i < count; i++)
+            data[rng() % frames][rng() % bits] = 1;
+        break;
+    }
+    case SyntheticContent::RANDOM:
+        for (auto &row : data) {
+            for (int b = 0; b < bits; b += 64) {
+                uint64_t word = rng();
+                for (int i = 0; i < 64 && b + i < bits; i++)
+                    row[b + i] = char((word >> i) & 1);
+            }
+        }
+        break;
+    case SyntheticContent::STRUCTURED:
+        for (const auto &tile : chip.indexed_tiles)
+            random_settings(*tile_dbs.at(tile->info.type), rng, tile->cram);
+        break;
+    }
+    chip.cram.generation->changed();
+
+    chip.usercode = uint32_t(seed);
+    chip.metadata = {"# Synthetic bitstream", "# Device: " + chip.info.name + " " + chip.info.package,
+                     "# Seed: " + std::to_string(seed)};
+    chip.bram_data.clear();
+    chip.pll_data.clear();
+    size_t payload_bytes = chip.info.bram_bits_per_frame / 8;
+    if (payload_bytes > 0) {
+        for (int i = 0; i < options.bram_blocks; i++)
+            chip.bram_data[uint8_t(i)] = random_payload(rng, payload_bytes);
+        for (int i = 0; i < options.plls; i++)
+            chip.pll_data[uint8_t(i)] = random_payload(rng, payload_bytes);
+    }
+    return chip;
+}
+
+string SyntheticGenerator::make_bitstream(uint64_t seed)
+{
+    make_chip(seed);
+    ostringstream out;
+    Bitstream::serialise_chip(chip, {}).write_bit(out);
+    string bit = out.str();
+    if (options.corruption == SyntheticCorruption::NONE || chip.cram.frames() == 0)
+        return bit;
+
+    // Corruption is chosen separately from the content, so the same seed corrupts the same content
+    mt19937_64 rng(seed ^ 0x5bd1e9955bd1e995ULL);
+    size_t metadata_bytes = 0;
+    for (const auto &line : chip.metadata)
+        metadata_bytes += line.size() + 1;
+    // A frame block is its size, the packed frame, the CRC and four bytes of padding
+    size_t frame_bytes = size_t(chip.cram.bits() / 8), block_bytes = 2 + frame_bytes + 2 + 4;
+    size_t block = metadata_bytes + header_bytes + (rng() % chip.cram.frames()) * block_bytes;
+    switch (options.corruption) {
+    case SyntheticCorruption::NONE:
+        break;
+    case SyntheticCorruption::FRAME:
+        bit.at(block + 2 + rng() % frame_bytes) ^= char(1 << (rng() % 8));
+        break;
+    case SyntheticCorruption::CRC:
+        bit.at(block + 2 + frame_bytes + rng() % 2) ^= char(1 << (rng() % 8));
+        break;
+    case SyntheticCorruption::TRUNCATE:
+        bit.resize(block + rng() % block_bytes);
+        break;
+    }
+    return bit;
+}
+
+static const char *synthetic_tile_types[] = {"plb", "emb", "iol"};
+
+static string config_bit(int frame, int bit, bool inverted = false)
+{
+    return string(inverted ? "!" : "") + "F" + std::to_string(frame) + "B" + std::to_string(bit);
+}
+
+// Routing muxes take pairs of frames from the start of the tile, words and an enum the last two frames
+static void write_synthetic_bits(const string &filename, const string &type, int frames, int bits)
+{
+    ofstream out(filename);
+    if (!out)
+        throw runtime_error("failed to open " + filename + " for writing");
+    out << "# Routing Mux Bits" << endl;
+    int muxes = min(12, (frames - 2) / 2);
+    for (int m = 0; m < muxes; m++) {
+        out << ".mux W" << m << "_" << type << endl;
+        for (int s = 0; s < 6; s++) {
+            out << "S" << s << "_" << m << " " << config_bit(m * 2, (s * 3) % bits) << " "
+                << config_bit(m * 2 + 1, (s * 5 + 1) % bits);
+            if (s % 2)
+                out << " " << config_bit(m * 2, bits - 14 + s);
+            out << endl;
+        }
+        out << "OFF -" << endl << endl;
+    }
+    out << "# Non-Routing Configuration" << endl;
+    for (int w = 0; w < min(4, bits / 16); w++) {
+        out << ".config LUT" << w << "_INIT " << string(16, '0') << endl;
+        for (int i = 0; i < 16; i++)
+            out << config_bit(frames - 2, w * 16 + i, i == 0) << endl;
+        out << endl;
+    }
+    out << ".config_enum MODE NORMAL" << endl << "NORMAL -" << endl << "FAST " << config_bit(frames - 1, 20) << endl
+        << "SLOW " << config_bit(frames - 1, 21) << " " << config_bit(frames - 1, 22) << endl << endl;
+    out << "# Fixed Connections" << endl << ".fixed_conn Q0 F0" << endl << ".fixed_conn Q1 F1" << endl;
+}
+
+static void write_synthetic_tilegrid(const string &filename, int max_col, int max_row, int frames, int bits)
+{
+    ofstream out(filename);
+    if (!out)
+        throw runtime_error("failed to open " + filename + " for writing");
+    out << "{";
+    for (int x = 0; x < max_col; x++) {
+        for (int y = 0; y < max_row; y++) {
+            string type = synthetic_tile_types[(x == 0) ? 2 : ((x % 10 == 5) ? 1 : 0)];
+            out << ((x || y) ? ",\n" : "\n") << "\"" << type << "_x" << x << "y" << y << "\": {\"x\": " << x
+                << ", \"y\": " << y << ", \"rows\": " << frames << ", \"cols\": " << bits << ", \"start_bit\": "
+                << y * bits << ", \"start_frame\": " << x * frames << ", \"type\": \"" << type << "\", \"flag\": 0}";
+        }
+    }
+    out << "\n}" << endl;
+}
+
+void write_synthetic_database(const string &root, const string &devices_file)
+{
+    pt::ptree devices;
+    pt::read_json(devices_file, devices);
+    fs::create_directories(root);
+    pt::write_json(root + "/devices.json", devices);
+    for (const auto &family : devices.get_child("families")) {
+        // Every tile of a type must be the same size, so tiles are sized to fit the smallest device of the family
+        int frames = INT_MAX, bits = INT_MAX;
+        for (const auto &dev : family.second.get_child("devices")) {
+            int max_col = dev.second.get<int>("max_col"), max_row = dev.second.get<int>("max_row");
+            frames = min(frames, dev.second.get<int>("frames") / max_col);
+            // The tilegrid loader moves tiles from bits 974 and 2926 on along by 6 bits each
+            bits = min(bits, (dev.second.get<int>("bits_per_frame") - 12) / max_row);
+        }
+        if (frames < 8 || bits < 48)
+            throw runtime_error("devices of family " + family.first + " are too small for a synthetic database");
+        for (const auto &dev : family.second.get_child("devices")) {
+            string dir = root + "/" + family.first + "/" + dev.first;
+            fs::create_directories(dir);
+            write_synthetic_tilegrid(dir + "/tilegrid.json", dev.second.get<int>("max_col"),
+                                     dev.second.get<int>("max_row"), frames, bits);
+        }
+        for (const char *type : synthetic_tile_types) {
+            string dir = root + "/" + family.first + "/tiledata/" + type;
+            fs::create_directories(dir);
+            write_synthetic_bits(dir + "/bits.db", type, frames, bits);
+        }
+    }
+}
+
+}
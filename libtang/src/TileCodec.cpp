@@ -0,0 +1,151 @@
+#include "TileCodec.hpp"
+#include "CRAM.hpp"
+#include "TileConfig.hpp"
+#ifndef NO_THREADS
+#include <atomic>
+#endif
+
+namespace Tang {
+
+#ifdef TANG_GENERATED_CODECS
+// Defined in the generated TileCodecs.cpp
+const TileCodec *generated_tile_codecs(size_t &count);
+#else
+static const TileCodec *generated_tile_codecs(size_t &count)
+{
+    count = 0;
+    return nullptr;
+}
+#endif
+
+uint64_t database_hash(const string &text)
+{
+    // 64-bit FNV-1a, also computed by the generator
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : text) {
+        h ^= uint8_t(c);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+const TileCodec *find_tile_codec(uint64_t db_hash)
+{
+    size_t count;
+    const TileCodec *codecs = generated_tile_codecs(count);
+    for (size_t i = 0; i < count; i++)
+        if (codecs[i].db_hash == db_hash)
+            return &codecs[i];
+    return nullptr;
+}
+
+vector<const TileCodec *> get_tile_codecs()
+{
+    size_t count;
+    const TileCodec *codecs = generated_tile_codecs(count);
+    vector<const TileCodec *> result;
+    for (size_t i = 0; i < count; i++)
+        result.push_back(&codecs[i]);
+    return result;
+}
+
+#ifdef NO_THREADS
+static bool codecs_enabled = true;
+#else
+static atomic<bool> codecs_enabled{true};
+#endif
+
+void set_tile_codecs_enabled(bool enabled)
+{
+    codecs_enabled = enabled;
+}
+
+bool tile_codecs_enabled()
+{
+    return codecs_enabled;
+}
+
+void add_unknown_bits(const PackedCRAM &tile, const uint64_t *coverage, TileConfig &cfg)
+{
+    for (int f = 0; f < tile.frame_count; f++) {
+        for (int w = 0; w < tile.words_per_frame; w++) {
+            size_t i = size_t(f) * tile.words_per_frame + w;
+            for (uint64_t known = tile.words[i] & coverage[i]; known != 0; known &= known - 1)
+                cfg.total_known_bits++;
+            uint64_t unknown = tile.words[i] & ~coverage[i];
+            while (unknown != 0) {
+                int bit = 0;
+                while (((unknown >> bit) & 1) == 0)
+                    bit++;
+                unknown &= unknown - 1;
+                cfg.cunknowns.push_back(ConfigUnknown{f, w * 64 + bit});
+            }
+        }
+    }
+}
+
+CodecIndex::CodecIndex(const char *const *names, size_t name_count, const Key *keys, size_t key_count)
+{
+    symbols.reserve(name_count);
+    for (size_t i = 0; i < name_count; i++)
+        symbols.push_back(Symbol(names[i]));
+    for (size_t i = 0; i < key_count; i++)
+        entries[pack(keys[i].kind, symbols.at(keys[i].first), symbols.at(keys[i].second))] = keys[i].value;
+}
+
+uint64_t CodecIndex::pack(CodecEntry kind, Symbol first, Symbol second)
+{
+    // Symbol indices are well under 2^31
+    return (uint64_t(kind) << 62) | (uint64_t(first.index()) << 31) | second.index();
+}
+
+int CodecIndex::find(CodecEntry kind, Symbol first, Symbol second) const
+{
+    auto found = entries.find(pack(kind, first, second));
+    return (found == entries.end()) ? -1 : found->second;
+}
+
+bool codec_encode(const CodecEncoder &encoder, const TileConfig &cfg, CRAMView &tile)
+{
+    static const Symbol none_value("_NONE_");
+    const CodecIndex &index = encoder.index();
+    for (const auto &arc : cfg.carcs) {
+        int n = index.find(CodecEntry::ARC, arc.sink, arc.source);
+        if (n < 0)
+            return false;
+        encoder.set_arc(n, tile);
+    }
+    vector<char> found_words(encoder.word_count, 0), found_enums(encoder.enum_count, 0);
+    auto set_enum = [&](const ConfigEnum &ce) {
+        int e = index.find(CodecEntry::ENUM, ce.name);
+        if (e < 0)
+            return false;
+        if (ce.value != none_value) {
+            int option = index.find(CodecEntry::OPTION, ce.name, ce.value);
+            if (option < 0)
+                return false;
+            encoder.set_option(option, tile);
+        }
+        found_enums[e] = 1;
+        return true;
+    };
+    // Base enums first, as config_to_tile_cram
+    const string base_prefix = "BASE_";
+    for (const auto &ce : cfg.cenums)
+        if (ce.name.str().compare(0, base_prefix.length(), base_prefix) == 0 && !set_enum(ce))
+            return false;
+    for (const auto &cw : cfg.cwords) {
+        int w = index.find(CodecEntry::WORD, cw.name);
+        if (w < 0 || !encoder.set_word(w, cw.value, tile))
+            return false;
+        found_words[w] = 1;
+    }
+    for (const auto &ce : cfg.cenums)
+        if (ce.name.str().compare(0, base_prefix.length(), base_prefix) != 0 && !set_enum(ce))
+            return false;
+    for (auto unk : cfg.cunknowns)
+        tile.bit(unk.frame, unk.bit) = 1;
+    return encoder.set_defaults(found_words, found_enums, tile);
+}
+
+}
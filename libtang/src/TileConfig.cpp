@@ -1,6 +1,7 @@
 #include "TileConfig.hpp"
 #include "Util.hpp"
 #include "BitDatabase.hpp"
+#include "Scanner.hpp"
 #include <algorithm>
 #include <sstream>
 using namespace std;
@@ -96,15 +97,52 @@ istream &operator>>(istream &in, TileConfig &tc) {
     return in;
 }
 
-void TileConfig::add_arc(const string &sink, const string &source) {
+void scan_tile_config(Scanner &sc, TileConfig &tc, SymbolCache &symbols)
+{
+    tc.carcs.clear();
+    tc.cwords.clear();
+    tc.cenums.clear();
+    while (!sc.check_eor()) {
+        boost::string_ref type = sc.token();
+        if (type == "arc:") {
+            Symbol sink = symbols.get(record_token(sc));
+            Symbol source = symbols.get(record_token(sc));
+            tc.carcs.push_back(ConfigArc{sink, source});
+        } else if (type == "word:") {
+            Symbol name = symbols.get(record_token(sc));
+            boost::string_ref bits = record_token(sc);
+            tc.cwords.push_back(ConfigWord{name, vector<bool>()});
+            vector<bool> &value = tc.cwords.back().value;
+            value.reserve(bits.size());
+            // Values are written most significant bit first
+            for (auto c = bits.rbegin(); c != bits.rend(); ++c) {
+                if (*c != '0' && *c != '1')
+                    throw runtime_error("invalid word value " + bits.to_string() + " while reading config text");
+                value.push_back(*c == '1');
+            }
+        } else if (type == "enum:") {
+            Symbol name = symbols.get(record_token(sc));
+            Symbol value = symbols.get(record_token(sc));
+            tc.cenums.push_back(ConfigEnum{name, value});
+        } else if (type == "unknown:") {
+            ConfigBit c = cbit_from_str(record_token(sc).to_string());
+            tc.cunknowns.push_back(ConfigUnknown{c.frame, c.bit});
+            assert(!c.inv);
+        } else {
+            throw runtime_error("unexpected token " + type.to_string() + " while reading config text");
+        }
+    }
+}
+
+void TileConfig::add_arc(Symbol sink, Symbol source) {
     carcs.push_back({sink, source});
 }
 
-void TileConfig::add_word(const string &name, const vector<bool> &value) {
+void TileConfig::add_word(Symbol name, const vector<bool> &value) {
     cwords.push_back({name, value});
 }
 
-void TileConfig::add_enum(const string &name, const string &value) {
+void TileConfig::add_enum(Symbol name, Symbol value) {
     cenums.push_back({name, value});
 }
 
@@ -120,9 +158,15 @@ string TileConfig::to_string() const {
 }
 
 TileConfig TileConfig::from_string(const string &str) {
-    stringstream ss(str);
+    Scanner sc(str);
+    // Kept between calls, as building a cache costs far more than parsing one tile's config
+#ifdef NO_THREADS
+    static SymbolCache symbols;
+#else
+    thread_local SymbolCache symbols;
+#endif
     TileConfig tc;
-    ss >> tc;
+    scan_tile_config(sc, tc, symbols);
     return tc;
 }
 
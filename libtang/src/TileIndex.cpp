@@ -0,0 +1,170 @@
+#include "TileIndex.hpp"
+#include <algorithm>
+
+namespace Tang {
+
+// One past the last frame of a tile that lies inside the CRAM
+static size_t last_frame(const TileInfo &ti, int frames)
+{
+    return min(ti.frame_offset + ti.num_frames, size_t(frames));
+}
+
+TileIndex::TileIndex(const vector<TileInfo> &tile_infos, int frames) : frames(frames)
+{
+    // Tiles are stored by name, remembering their position in the tilegrid
+    vector<uint32_t> grid_order(tile_infos.size());
+    for (size_t i = 0; i < tile_infos.size(); i++)
+        grid_order[i] = uint32_t(i);
+    stable_sort(grid_order.begin(), grid_order.end(),
+                [&](uint32_t a, uint32_t b) { return tile_infos[a].name < tile_infos[b].name; });
+    vector<uint32_t> id_at_grid_pos(tile_infos.size());
+    tiles.reserve(tile_infos.size());
+    for (size_t id = 0; id < grid_order.size(); id++) {
+        tiles.push_back(tile_infos[grid_order[id]]);
+        id_at_grid_pos[grid_order[id]] = uint32_t(id);
+    }
+
+    // Count the tiles in each frame, then fill in the compressed rows
+    frame_start.assign(size_t(frames) + 1, 0);
+    frame_max_bits.assign(size_t(frames), 0);
+    for (const auto &ti : tiles) {
+        for (size_t f = ti.frame_offset; f < last_frame(ti, frames); f++) {
+            frame_start[f + 1]++;
+            frame_max_bits[f] = max(frame_max_bits[f], uint32_t(ti.bits_per_frame));
+        }
+        max_frames = max(max_frames, ti.num_frames);
+    }
+    for (int f = 0; f < frames; f++)
+        frame_start[f + 1] += frame_start[f];
+    frame_tiles.resize(frame_start.back());
+    vector<uint32_t> fill_pos(frame_start.begin(), frame_start.end() - 1);
+    for (size_t id = 0; id < tiles.size(); id++) {
+        const TileInfo &ti = tiles[id];
+        for (size_t f = ti.frame_offset; f < last_frame(ti, frames); f++)
+            frame_tiles[fill_pos[f]++] = uint32_t(id);
+    }
+    for (int f = 0; f < frames; f++)
+        sort(frame_tiles.begin() + frame_start[f], frame_tiles.begin() + frame_start[f + 1],
+             [this](uint32_t a, uint32_t b) { return tiles[a].bit_offset < tiles[b].bit_offset; });
+
+    by_first_frame.resize(tiles.size());
+    for (size_t id = 0; id < tiles.size(); id++)
+        by_first_frame[id] = uint32_t(id);
+    stable_sort(by_first_frame.begin(), by_first_frame.end(),
+                [this](uint32_t a, uint32_t b) { return tiles[a].frame_offset < tiles[b].frame_offset; });
+
+    by_type = by_first_frame;
+    stable_sort(by_type.begin(), by_type.end(), [this](uint32_t a, uint32_t b) {
+        return tiles[a].type < tiles[b].type || (tiles[a].type == tiles[b].type && a < b);
+    });
+    for (size_t i = 0; i < by_type.size(); i++) {
+        Symbol type = tiles[by_type[i]].type;
+        if (i == 0 || type != tiles[by_type[i - 1]].type)
+            type_ranges[type] = make_pair(i, i);
+        type_ranges[type].second = i + 1;
+    }
+
+    for (const auto &ti : tiles) {
+        grid_rows = max(grid_rows, int(ti.row) + 1);
+        grid_cols = max(grid_cols, int(ti.col) + 1);
+    }
+    location_start.assign(size_t(grid_rows) * grid_cols + 1, 0);
+    for (const auto &ti : tiles)
+        location_start[ti.row * grid_cols + ti.col + 1]++;
+    for (size_t i = 1; i < location_start.size(); i++)
+        location_start[i] += location_start[i - 1];
+    by_location.resize(tiles.size());
+    vector<uint32_t> location_fill(location_start.begin(), location_start.end() - 1);
+    // Visit the tiles in tilegrid order, so each location keeps that order
+    for (uint32_t id : id_at_grid_pos) {
+        const TileInfo &ti = tiles[id];
+        by_location[location_fill[ti.row * grid_cols + ti.col]++] = id;
+    }
+}
+
+size_t TileIndex::size() const
+{
+    return tiles.size();
+}
+
+const TileInfo &TileIndex::info(size_t id) const
+{
+    return tiles.at(id);
+}
+
+vector<size_t> TileIndex::tiles_at_bit(int frame, int bit) const
+{
+    vector<size_t> result;
+    if (frame < 0 || frame >= frames || bit < 0)
+        return result;
+    auto begin = frame_tiles.begin() + frame_start[frame], end = frame_tiles.begin() + frame_start[frame + 1];
+    // First tile starting after the bit, all candidates are before it
+    auto it = upper_bound(begin, end, size_t(bit),
+                          [this](size_t b, uint32_t id) { return b < tiles[id].bit_offset; });
+    while (it != begin) {
+        --it;
+        const TileInfo &ti = tiles[*it];
+        if (ti.bit_offset + frame_max_bits[frame] <= size_t(bit))
+            break;
+        if (size_t(bit) < ti.bit_offset + ti.bits_per_frame)
+            result.push_back(*it);
+    }
+    sort(result.begin(), result.end());
+    return result;
+}
+
+vector<size_t> TileIndex::tiles_in_frames(int first_frame, int last_frame) const
+{
+    vector<size_t> result;
+    if (last_frame < first_frame)
+        return result;
+    // Any tile covering first_frame must start no earlier than this
+    size_t earliest = (size_t(max(first_frame, 0)) + 1 > max_frames) ? size_t(max(first_frame, 0)) + 1 - max_frames : 0;
+    auto it = lower_bound(by_first_frame.begin(), by_first_frame.end(), earliest,
+                          [this](uint32_t id, size_t f) { return tiles[id].frame_offset < f; });
+    for (; it != by_first_frame.end() && int(tiles[*it].frame_offset) <= last_frame; ++it) {
+        const TileInfo &ti = tiles[*it];
+        if (int(ti.frame_offset + ti.num_frames) > first_frame)
+            result.push_back(*it);
+    }
+    sort(result.begin(), result.end());
+    return result;
+}
+
+const vector<uint32_t> &TileIndex::type_order() const
+{
+    return by_type;
+}
+
+pair<size_t, size_t> TileIndex::type_range(Symbol type) const
+{
+    auto found = type_ranges.find(type);
+    if (found == type_ranges.end())
+        return make_pair(size_t(0), size_t(0));
+    return found->second;
+}
+
+const vector<uint32_t> &TileIndex::location_order() const
+{
+    return by_location;
+}
+
+pair<size_t, size_t> TileIndex::location_range(int row, int col) const
+{
+    if (row < 0 || row >= grid_rows || col < 0 || col >= grid_cols)
+        return make_pair(size_t(0), size_t(0));
+    size_t cell = size_t(row) * grid_cols + col;
+    return make_pair(size_t(location_start[cell]), size_t(location_start[cell + 1]));
+}
+
+int TileIndex::rows() const
+{
+    return grid_rows;
+}
+
+int TileIndex::cols() const
+{
+    return grid_cols;
+}
+
+}
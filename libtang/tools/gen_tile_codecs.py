@@ -0,0 +1,573 @@
+#!/usr/bin/env python3
+
+"""
+Generate C++ decoders and encoders for each tile type in a Project Tang database
+
+Every <family>/tiledata/<type>/bits.db under the database directory is parsed exactly as
+TileBitDatabase::load parses it, and turned into straight-line code with the same results as
+TileBitDatabase::tile_cram_to_config and config_to_tile_cram, registered under the hash of the file
+(see libtang/include/TileCodec.hpp). Tile types whose database cannot be parsed are skipped, leaving
+them to the generic path.
+"""
+
+import argparse
+import glob
+import os
+import sys
+
+parser = argparse.ArgumentParser(description=__doc__)
+parser.add_argument('database', type=str,
+                    help="database root directory")
+parser.add_argument('outfile', type=str,
+                    help="output C++ file")
+
+# Entries per generated function, keeping functions small enough to compile quickly
+chunk_size = 64
+
+
+def database_hash(data):
+    """64-bit FNV-1a of the file, as Tang::database_hash"""
+    h = 0xcbf29ce484222325
+    for c in data:
+        h ^= c
+        h = (h * 0x100000001b3) & 0xffffffffffffffff
+    return h
+
+
+class ParseError(Exception):
+    pass
+
+
+class Scanner:
+    """Port of Tang::Scanner, working on bytes"""
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+        self.end = len(data)
+
+    def skip_blank(self, nl=False):
+        while self.pos != self.end and (self.data[self.pos] in b' \t' or (nl and self.data[self.pos] in b'\n\r')):
+            self.pos += 1
+
+    def check_eol(self):
+        self.skip_blank(False)
+        if self.pos != self.end and self.data[self.pos] == ord('#'):
+            while self.pos != self.end and self.data[self.pos] != ord('\n'):
+                self.pos += 1
+            return True
+        return self.pos == self.end or self.data[self.pos] == ord('\n')
+
+    def skip(self):
+        self.skip_blank(True)
+        while self.pos != self.end and self.data[self.pos] == ord('#'):
+            self.check_eol()
+            self.skip_blank(True)
+
+    def check_eor(self):
+        self.skip()
+        return self.pos == self.end or self.data[self.pos] == ord('.')
+
+    def check_eof(self):
+        self.skip()
+        return self.pos == self.end
+
+    def token(self):
+        while self.pos != self.end and self.data[self.pos] in b' \t\n\r\v\f':
+            self.pos += 1
+        start = self.pos
+        while self.pos != self.end and self.data[self.pos] not in b' \t\n\r\v\f':
+            self.pos += 1
+        return self.data[start:self.pos]
+
+
+def parse_uint(tok, p):
+    """Parse a decimal number at tok[p:], as Scanner::parse_uint, returning (value, end) or None"""
+    if p == len(tok) or not (ord('0') <= tok[p] <= ord('9')):
+        return None
+    value = 0
+    while p != len(tok) and ord('0') <= tok[p] <= ord('9'):
+        value = value * 10 + tok[p] - ord('0')
+        if value > 0x7fffffff:
+            return None
+        p += 1
+    return value, p
+
+
+def parse_config_bit(tok):
+    """Parse [!]F<frame>B<bit> into (frame, bit, inv)"""
+    p = 0
+    inv = False
+    if p != len(tok) and tok[p] == ord('!'):
+        inv = True
+        p += 1
+    if p == len(tok) or tok[p] != ord('F'):
+        raise ParseError("invalid config bit " + tok.decode('latin-1'))
+    frame = parse_uint(tok, p + 1)
+    if frame is None or frame[1] == len(tok) or tok[frame[1]] != ord('B'):
+        raise ParseError("invalid config bit " + tok.decode('latin-1'))
+    bit = parse_uint(tok, frame[1] + 1)
+    if bit is None or bit[1] != len(tok):
+        raise ParseError("invalid config bit " + tok.decode('latin-1'))
+    # Sorted by (frame, bit, inv) like ConfigBit
+    return frame[0], bit[0], inv
+
+
+def scan_bitgroup(sc):
+    bits = set()
+    while not sc.check_eol():
+        tok = sc.token()
+        if tok == b'-':
+            break
+        bits.add(parse_config_bit(tok))
+    return tuple(sorted(bits))
+
+
+def scan_mux(sc):
+    arcs = {}
+    while not sc.check_eor():
+        source = sc.token()
+        arcs[source] = scan_bitgroup(sc)
+    return arcs
+
+
+def scan_word(sc):
+    defval = None
+    if not sc.check_eol():
+        defval = [c == ord('1') for c in reversed(sc.token())]
+    bits = []
+    while not sc.check_eor():
+        bits.append(scan_bitgroup(sc))
+    if defval is None:
+        defval = [False] * len(bits)
+    return defval, bits
+
+
+def scan_enum(sc):
+    defval = None
+    if not sc.check_eol():
+        defval = sc.token()
+    options = {}
+    while not sc.check_eor():
+        opt = sc.token()
+        options[opt] = scan_bitgroup(sc)
+    return defval, options
+
+
+class TileDatabase:
+    def __init__(self, data):
+        self.muxes = {}
+        self.words = {}
+        self.enums = {}
+        sc = Scanner(data)
+        while not sc.check_eof():
+            tok = sc.token()
+            if tok == b'.mux':
+                sink = sc.token()
+                self.muxes[sink] = scan_mux(sc)
+            elif tok == b'.config':
+                name = sc.token()
+                self.words[name] = scan_word(sc)
+            elif tok == b'.config_enum':
+                name = sc.token()
+                self.enums[name] = scan_enum(sc)
+            elif tok == b'.fixed_conn':
+                sc.token()
+                sc.token()
+            else:
+                raise ParseError("unexpected token " + tok.decode('latin-1'))
+
+    def groups(self):
+        for arcs in self.muxes.values():
+            yield from arcs.values()
+        for defval, bits in self.words.values():
+            yield from bits
+        for defval, options in self.enums.values():
+            yield from options.values()
+
+
+def preference_order(candidates):
+    """Order (name, bits) pairs as best-match selection prefers them: most bits, then latest name"""
+    ordered = sorted(candidates, key=lambda c: c[0], reverse=True)
+    return sorted(ordered, key=lambda c: -len(c[1]))
+
+
+def c_string(s):
+    result = '"'
+    for c in s:
+        if chr(c).isalnum() or chr(c) in "_.:/<>[]()+-=$@%&*,;":
+            result += chr(c)
+        else:
+            result += "\\%03o" % c
+    return result + '"'
+
+
+def group_words(bits):
+    """Split a group into per-word (frame, word, ones, zeros) masks, or None if it can never match"""
+    words = {}
+    for frame, bit, inv in bits:
+        ones, zeros = words.get((frame, bit // 64), (0, 0))
+        if inv:
+            zeros |= 1 << (bit % 64)
+        else:
+            ones |= 1 << (bit % 64)
+        words[(frame, bit // 64)] = (ones, zeros)
+    if any(ones & zeros for ones, zeros in words.values()):
+        return None
+    return [(f, w, ones, zeros) for (f, w), (ones, zeros) in sorted(words.items())]
+
+
+def word_index(frame, word):
+    return "%d * w + %d" % (frame, word) if frame > 0 else "%d" % word
+
+
+def match_expr(bits):
+    words = group_words(bits)
+    if words is None:
+        return "false"
+    if len(words) == 0:
+        return "true"
+    return " && ".join("(t[%s] & 0x%xULL) == 0x%xULL" % (word_index(f, w), ones | zeros, ones)
+                       for f, w, ones, zeros in words)
+
+
+def branch(first, cond):
+    """The start of the next branch of an if/else chain"""
+    if cond == "true":
+        return "" if first else "else "
+    return ("if (%s) " if first else "else if (%s) ") % cond
+
+
+def coverage_stmts(bits, value, indent):
+    """Statements adding the coverage of a group, as BitGroup::add_coverage"""
+    masks = {}
+    for frame, bit, inv in bits:
+        if inv != value:
+            masks[(frame, bit // 64)] = masks.get((frame, bit // 64), 0) | (1 << (bit % 64))
+    return ["%sc[%s] |= 0x%xULL;\n" % (indent, word_index(f, w), m) for (f, w), m in sorted(masks.items())]
+
+
+class CodecWriter:
+    def __init__(self, out, prefix, family, tile_type, db, db_hash):
+        self.out = out
+        self.prefix = prefix
+        self.family = family
+        self.tile_type = tile_type
+        self.db = db
+        self.db_hash = db_hash
+        self.names = [b'', b'_NONE_']
+        self.name_index = {b'': 0, b'_NONE_': 1}
+        self.mux_names = sorted(db.muxes.keys())
+        self.word_names = sorted(db.words.keys())
+        self.enum_names = sorted(db.enums.keys())
+        # Arcs and options are numbered across the whole tile type, in name order
+        self.arcs = [(sink, source, db.muxes[sink][source])
+                     for sink in self.mux_names for source in sorted(db.muxes[sink].keys())]
+        self.options = [(name, opt, db.enums[name][1][opt])
+                        for name in self.enum_names for opt in sorted(db.enums[name][1].keys())]
+        self.frames = 0
+        self.bits = 0
+        for group in db.groups():
+            for frame, bit, inv in group:
+                self.frames = max(self.frames, frame + 1)
+                self.bits = max(self.bits, bit + 1)
+
+    def name(self, n):
+        if n not in self.name_index:
+            self.name_index[n] = len(self.names)
+            self.names.append(n)
+        return self.name_index[n]
+
+    def write(self, text):
+        self.out.write(text)
+
+    def chunked(self, kind, entries, signature, call, emit):
+        """Write entries in functions of chunk_size, returning their names"""
+        parts = []
+        for start in range(0, len(entries), chunk_size):
+            part = "%s_%s_%d" % (self.prefix, kind, len(parts))
+            self.write("static %s\n{\n" % (signature % part))
+            for i, entry in enumerate(entries[start:start + chunk_size]):
+                emit(start + i, entry)
+            self.write("%s}\n\n" % call)
+            parts.append(part)
+        return parts
+
+    def write_index(self):
+        keys = []
+        for i, (sink, source, bits) in enumerate(self.arcs):
+            keys.append(("ARC", self.name(sink), self.name(source), i))
+        for i, name in enumerate(self.word_names):
+            keys.append(("WORD", self.name(name), 0, i))
+        for i, name in enumerate(self.enum_names):
+            keys.append(("ENUM", self.name(name), 0, i))
+        for i, (name, opt, bits) in enumerate(self.options):
+            keys.append(("OPTION", self.name(name), self.name(opt), i))
+        for name in self.enum_names:
+            defval = self.db.enums[name][0]
+            if defval is not None:
+                self.name(defval)
+        self.write("static const char *const %s_names[] = {\n" % self.prefix)
+        for n in self.names:
+            self.write("    %s,\n" % c_string(n))
+        self.write("};\n\n")
+        if len(keys) > 0:
+            self.write("static const CodecIndex::Key %s_keys[] = {\n" % self.prefix)
+            for kind, first, second, value in keys:
+                self.write("    {CodecEntry::%s, %d, %d, %d},\n" % (kind, first, second, value))
+            self.write("};\n\n")
+        self.write("static const CodecIndex &%s_index()\n{\n" % self.prefix)
+        self.write("    static const CodecIndex index(%s_names, %d, %s, %d);\n" %
+                   (self.prefix, len(self.names), ("%s_keys" % self.prefix) if len(keys) > 0 else "nullptr",
+                    len(keys)))
+        self.write("    return index;\n}\n\n")
+
+    def decode_mux(self, i, sink):
+        arcs = preference_order(self.db.muxes[sink].items())
+        first = True
+        for source, bits in arcs:
+            cond = match_expr(bits)
+            if cond == "false":
+                continue
+            self.write("    %s{\n" % branch(first, cond))
+            for stmt in coverage_stmts(bits, True, "        "):
+                self.write(stmt)
+            if len(bits) > 0:
+                self.write("        cfg.carcs.push_back(ConfigArc{s[%d], s[%d]});\n" %
+                           (self.name_index[sink], self.name_index[source]))
+            self.write("    }\n")
+            first = False
+            if cond == "true":
+                break
+
+    def decode_word(self, i, name):
+        defval, groups = self.db.words[name]
+        self.write("    {\n")
+        self.write("        static const vector<bool> defval{%s};\n" %
+                   ", ".join("true" if v else "false" for v in defval))
+        self.write("        vector<bool> value(%d);\n" % len(groups))
+        for j, bits in enumerate(groups):
+            self.write("        if (%s) {\n" % match_expr(bits))
+            self.write("            value[%d] = true;\n" % j)
+            for stmt in coverage_stmts(bits, True, "            "):
+                self.write(stmt)
+            self.write("        } else {\n")
+            for stmt in coverage_stmts(bits, False, "            "):
+                self.write(stmt)
+            self.write("        }\n")
+        self.write("        if (value != defval)\n")
+        self.write("            cfg.cwords.push_back(ConfigWord{s[%d], value});\n" % self.name_index[name])
+        self.write("    }\n")
+
+    def decode_enum(self, i, name):
+        defval, options = self.db.enums[name]
+        first = True
+        matched_all = False
+        for opt, bits in preference_order(options.items()):
+            cond = match_expr(bits)
+            if cond == "false":
+                continue
+            self.write("    %s{\n" % branch(first, cond))
+            for stmt in coverage_stmts(bits, True, "        "):
+                self.write(stmt)
+            if defval is None:
+                self.write("        cfg.cenums.push_back(ConfigEnum{s[%d], s[%d]});\n" %
+                           (self.name_index[name], self.name_index[opt]))
+            elif defval not in options:
+                # The generic path fails looking up the default
+                self.write("        return false;\n")
+            elif options[defval] != bits:
+                self.write("        cfg.cenums.push_back(ConfigEnum{s[%d], s[%d]});\n" %
+                           (self.name_index[name], self.name_index[opt]))
+            self.write("    }\n")
+            first = False
+            if cond == "true":
+                matched_all = True
+                break
+        if defval is not None and not matched_all:
+            self.write("    %s{\n" % ("" if first else "else "))
+            self.write("        cfg.cenums.push_back(ConfigEnum{s[%d], s[1]});\n" % self.name_index[name])
+            self.write("    }\n")
+
+    def write_decode(self):
+        signature = "bool %s(const uint64_t *t, int w, uint64_t *c, const vector<Symbol> &s, TileConfig &cfg)"
+        entries = [(self.decode_mux, n) for n in self.mux_names] + \
+                  [(self.decode_word, n) for n in self.word_names] + \
+                  [(self.decode_enum, n) for n in self.enum_names]
+        parts = self.chunked("decode", entries, signature, "    return true;\n",
+                             lambda i, e: e[0](i, e[1]))
+        self.write("static bool %s_decode(const PackedCRAM &tile, TileConfig &cfg)\n{\n" % self.prefix)
+        self.write("    if (tile.frame_count < %d || tile.bit_count < %d)\n" % (self.frames, self.bits))
+        self.write("        return false;\n")
+        self.write("    vector<uint64_t> coverage(tile.words.size(), 0);\n")
+        if len(parts) > 0:
+            self.write("    const vector<Symbol> &s = %s_index().symbols;\n" % self.prefix)
+            for part in parts:
+                self.write("    if (!%s(tile.words.data(), tile.words_per_frame, coverage.data(), s, cfg))\n" % part)
+                self.write("        return false;\n")
+        self.write("    add_unknown_bits(tile, coverage.data(), cfg);\n")
+        self.write("    return true;\n}\n\n")
+
+    def set_bits(self, bits, value, indent):
+        # In sorted order, as BitGroup::set_group, so a bit given twice ends the same way
+        for frame, bit, inv in bits:
+            if value is None:
+                self.write("%stile.bit(%d, %d) = %d;\n" % (indent, frame, bit, 0 if inv else 1))
+            else:
+                self.write("%stile.bit(%d, %d) = %s%s;\n" % (indent, frame, bit, "!" if inv else "", value))
+
+    def write_switch(self, kind, entries, signature, result, emit):
+        """Write a function switching on an entry number, split into parts of chunk_size entries"""
+        parts = []
+        for start in range(0, len(entries), chunk_size):
+            part = "%s_%s_%d" % (self.prefix, kind, len(parts))
+            self.write("static %s\n{\n" % (signature % part))
+            self.write("    switch (n) {\n")
+            for i, entry in enumerate(entries[start:start + chunk_size]):
+                self.write("    case %d:\n" % (start + i))
+                emit(entry)
+                self.write("        break;\n")
+            self.write("    }\n%s}\n\n" % result)
+            parts.append(part)
+        return parts
+
+    def write_dispatch(self, kind, parts, signature, args, result):
+        """Write the function calling the part of write_switch holding an entry"""
+        self.write("static %s\n{\n" % (signature % ("%s_%s" % (self.prefix, kind))))
+        if len(parts) == 0:
+            self.write("%s}\n\n" % result)
+            return
+        self.write("    static %s = {%s};\n" % (signature % "(*const parts[])", ", ".join(parts)))
+        self.write("    %sparts[n / %d](%s);\n}\n\n" % ("return " if result else "", chunk_size, ", ".join(args)))
+
+    def write_encode(self):
+        p = self.prefix
+        arc_signature = "void %s(int n, CRAMView &tile)"
+        parts = self.write_switch("set_arc", self.arcs, arc_signature, "",
+                                  lambda e: self.set_bits(e[2], None, "        "))
+        self.write_dispatch("set_arc", parts, arc_signature, ["n", "tile"], "")
+
+        def set_word(name):
+            defval, groups = self.db.words[name]
+            self.write("        if (value.size() != %d)\n" % len(groups))
+            self.write("            return false;\n")
+            for j, bits in enumerate(groups):
+                self.set_bits(bits, "value[%d]" % j, "        ")
+
+        word_signature = "bool %s(int n, const vector<bool> &value, CRAMView &tile)"
+        parts = self.write_switch("set_word", self.word_names, word_signature, "    return true;\n", set_word)
+        self.write_dispatch("set_word", parts, word_signature, ["n", "value", "tile"], "    return true;\n")
+
+        option_signature = "void %s(int n, CRAMView &tile)"
+        parts = self.write_switch("set_option", self.options, option_signature, "",
+                                  lambda e: self.set_bits(e[2], None, "        "))
+        self.write_dispatch("set_option", parts, option_signature, ["n", "tile"], "")
+
+        def default_word(i, name):
+            defval, groups = self.db.words[name]
+            self.write("    if (!found_words[%d]) {\n" % i)
+            if len(defval) != len(groups):
+                self.write("        return false;\n")
+            else:
+                for j, bits in enumerate(groups):
+                    self.set_bits(bits, "true" if defval[j] else "false", "        ")
+            self.write("    }\n")
+
+        def default_enum(i, name):
+            defval, options = self.db.enums[name]
+            if defval is None or defval == b'_NONE_':
+                return
+            self.write("    if (!found_enums[%d]) {\n" % i)
+            if defval not in options:
+                self.write("        return false;\n")
+            else:
+                self.set_bits(options[defval], None, "        ")
+            self.write("    }\n")
+
+        defaults_signature = \
+            "bool %s(const vector<char> &found_words, const vector<char> &found_enums, CRAMView &tile)"
+        entries = [(default_word, i, n) for i, n in enumerate(self.word_names)] + \
+                  [(default_enum, i, n) for i, n in enumerate(self.enum_names)]
+        parts = []
+        for start in range(0, len(entries), chunk_size):
+            part = "%s_set_defaults_%d" % (p, len(parts))
+            self.write("static %s\n{\n" % (defaults_signature % part))
+            for emit, i, name in entries[start:start + chunk_size]:
+                emit(i, name)
+            self.write("    return true;\n}\n\n")
+            parts.append(part)
+        self.write("static %s\n{\n" % (defaults_signature % ("%s_set_defaults" % p)))
+        for part in parts:
+            self.write("    if (!%s(found_words, found_enums, tile))\n        return false;\n" % part)
+        self.write("    return true;\n}\n\n")
+
+        self.write("static const CodecEncoder %s_encoder{%s_index, %d, %d, %s_set_arc, %s_set_word, %s_set_option, "
+                   "%s_set_defaults};\n\n" % (p, p, len(self.word_names), len(self.enum_names), p, p, p, p))
+        self.write("static bool %s_encode(const TileConfig &cfg, CRAMView &tile)\n{\n" % p)
+        self.write("    if (tile.frames() < %d || tile.bits() < %d)\n" % (self.frames, self.bits))
+        self.write("        return false;\n")
+        self.write("    return codec_encode(%s_encoder, cfg, tile);\n}\n\n" % p)
+
+    def write_codec(self):
+        self.write("// %s %s\n\n" % (self.family, self.tile_type))
+        self.write_index()
+        self.write_decode()
+        self.write_encode()
+
+    def registry_entry(self):
+        return "{%s, %s, 0x%016xULL, %d, %d, %s_decode, %s_encode}" % (
+            c_string(self.family.encode()), c_string(self.tile_type.encode()), self.db_hash, self.frames, self.bits,
+            self.prefix, self.prefix)
+
+
+def main(argv):
+    args = parser.parse_args(argv)
+    codecs = []
+    text = []
+    # Codecs are found by hash alone, so identical files (the same tile type in several families) share one codec
+    generated = {}
+
+    class Buffer:
+        def write(self, s):
+            text.append(s)
+
+    for filename in sorted(glob.glob(os.path.join(args.database, "*", "tiledata", "*", "bits.db"))):
+        tile_type = os.path.basename(os.path.dirname(filename))
+        family = os.path.basename(os.path.dirname(os.path.dirname(os.path.dirname(filename))))
+        with open(filename, "rb") as f:
+            data = f.read()
+        db_hash = database_hash(data)
+        if db_hash in generated:
+            print("{}: same as {}, codec shared".format(filename, generated[db_hash]), file=sys.stderr)
+            continue
+        try:
+            db = TileDatabase(data)
+        except ParseError as e:
+            print("{}: {}, tile type skipped".format(filename, e), file=sys.stderr)
+            continue
+        writer = CodecWriter(Buffer(), "t%d" % len(codecs), family, tile_type, db, db_hash)
+        writer.write_codec()
+        codecs.append(writer)
+        generated[db_hash] = filename
+
+    with open(args.outfile + ".tmp", "w") as f:
+        f.write("// Generated by gen_tile_codecs.py from %d tile type databases, do not edit\n\n" % len(codecs))
+        f.write('#include "TileCodec.hpp"\n#include "TileConfig.hpp"\n#include "CRAM.hpp"\n\n')
+        f.write("namespace Tang {\n\n")
+        f.write("".join(text))
+        if len(codecs) > 0:
+            f.write("static const TileCodec codecs[] = {\n")
+            for c in codecs:
+                f.write("    %s,\n" % c.registry_entry())
+            f.write("};\n\n")
+        f.write("const TileCodec *generated_tile_codecs(size_t &count)\n{\n")
+        if len(codecs) > 0:
+            f.write("    count = %d;\n    return codecs;\n}\n\n" % len(codecs))
+        else:
+            f.write("    count = 0;\n    return nullptr;\n}\n\n")
+        f.write("}\n")
+    os.replace(args.outfile + ".tmp", args.outfile)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
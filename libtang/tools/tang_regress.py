@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+
+"""
+End-to-end throughput regression check for the Tang tools
+
+A synthetic database and corpus are generated with tanggen for one device of every family in devices.json. Each
+bitstream is then put through tangbit (re-serialise), tangunpack (bitstream to config) and tangpack (config to
+bitstream). For every device and stage the wall time, throughput in bitstream bytes per second, peak RSS and heap
+allocation count are recorded, each stage being run a few times and the fastest run kept.
+
+Results are compared against a baseline file written by an earlier run with --update. The exit status is 0 when
+nothing has regressed beyond the tolerances, 1 when something has, and 2 when a tool fails or the baseline was made
+with different corpus options. Allocation counts need libtangalloccount.so from the build directory and are left
+out without it. Baselines are only comparable on the same machine.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import sys
+import tempfile
+import time
+
+parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+parser.add_argument('--bindir', type=str, default=".",
+                    help="directory containing the Tang tools, default is the current directory")
+parser.add_argument('--prefix', type=str, default="",
+                    help="name prefix of the tools, as PROGRAM_PREFIX of the build")
+parser.add_argument('--devices', type=str,
+                    default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "devices.json"),
+                    help="devices.json to take the families and devices from")
+parser.add_argument('--baseline', type=str, required=True,
+                    help="baseline results to compare against, or to write with --update")
+parser.add_argument('--update', action='store_true',
+                    help="write the results as the new baseline instead of comparing")
+parser.add_argument('--all-devices', action='store_true',
+                    help="run every device rather than the first of each family")
+parser.add_argument('--count', type=int, default=3,
+                    help="bitstreams per device")
+parser.add_argument('--repeat', type=int, default=5,
+                    help="runs of each stage, the fastest of which is kept")
+parser.add_argument('--content', type=str, default="sparse",
+                    help="tanggen content of the corpus")
+parser.add_argument('--tolerance', type=float, default=0.15,
+                    help="allowed relative drop in throughput")
+parser.add_argument('--memory-tolerance', type=float, default=0.05,
+                    help="allowed relative growth in peak RSS and allocations")
+parser.add_argument('--workdir', type=str,
+                    help="keep the database, corpus and outputs in this directory, replacing only the harness's "
+                         "own db, corpus and out subdirectories")
+
+baseline_version = 1
+
+# Everything the harness writes to the work directory, and all it removes from one given with --workdir
+work_subdirs = ["db", "corpus", "out"]
+work_files = ["alloc_count", "stderr.log"]
+
+
+class ToolError(Exception):
+    pass
+
+
+class Runner:
+    def __init__(self, bindir, prefix, workdir):
+        self.bindir = os.path.abspath(bindir)
+        self.prefix = prefix
+        self.workdir = workdir
+        self.env = dict(os.environ)
+        # The tools' RPATH is for the install tree, so libtang is found in the build directory through the path
+        libpath = [self.bindir] + ([self.env["LD_LIBRARY_PATH"]] if "LD_LIBRARY_PATH" in self.env else [])
+        self.env["LD_LIBRARY_PATH"] = os.pathsep.join(libpath)
+        self.alloc_file = None
+        alloc_lib = os.path.join(self.bindir, "libtangalloccount.so")
+        if os.path.exists(alloc_lib):
+            self.alloc_file = os.path.join(workdir, "alloc_count")
+            self.env["LD_PRELOAD"] = alloc_lib
+            self.env["TANG_ALLOC_COUNT"] = self.alloc_file
+
+    def tool(self, name):
+        path = os.path.join(self.bindir, self.prefix + name)
+        if not os.path.exists(path):
+            raise ToolError("{} not found in {}".format(name, self.bindir))
+        return path
+
+    def run(self, args):
+        """Run a tool once, returning the wall time, peak RSS in KiB and allocation count"""
+        if self.alloc_file is not None and os.path.exists(self.alloc_file):
+            os.remove(self.alloc_file)
+        log = os.path.join(self.workdir, "stderr.log")
+        actions = [(os.POSIX_SPAWN_OPEN, 1, os.devnull, os.O_WRONLY, 0),
+                   (os.POSIX_SPAWN_OPEN, 2, log, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)]
+        start = time.perf_counter()
+        pid = os.posix_spawn(self.tool(args[0]), args, self.env, file_actions=actions)
+        _, status, usage = os.wait4(pid, 0)
+        seconds = time.perf_counter() - start
+        if os.waitstatus_to_exitcode(status) != 0:
+            with open(log) as f:
+                raise ToolError("{} failed:\n{}".format(" ".join(args), f.read()))
+        allocations = None
+        if self.alloc_file is not None and os.path.exists(self.alloc_file):
+            with open(self.alloc_file) as f:
+                allocations = int(f.read())
+        # ru_maxrss is in KiB on Linux
+        return seconds, usage.ru_maxrss, allocations
+
+    def measure(self, runs, repeat):
+        """Run each command of a stage repeat times, keeping the fastest time and the largest memory use"""
+        result = {"seconds": 0.0, "peak_rss_kb": 0, "allocations": 0}
+        for args in runs:
+            times = []
+            for _ in range(repeat):
+                seconds, rss, allocations = self.run(args)
+                times.append(seconds)
+                result["peak_rss_kb"] = max(result["peak_rss_kb"], rss)
+            result["seconds"] += min(times)
+            # The count is the same from run to run, so the last one is kept
+            if allocations is None or result["allocations"] is None:
+                result["allocations"] = None
+            else:
+                result["allocations"] += allocations
+        return result
+
+
+def select_devices(devices_file, all_devices):
+    with open(devices_file) as f:
+        devices = json.load(f)
+    selected = []
+    for family, family_data in devices["families"].items():
+        for device, device_data in family_data["devices"].items():
+            selected.append((family, device, next(iter(device_data["packages"]))))
+            if not all_devices:
+                break
+    return selected
+
+
+def run_stages(runner, args, workdir):
+    db = os.path.join(workdir, "db")
+    runner.run(["tanggen", "--make-db", db, "--devices", os.path.abspath(args.devices)])
+    results = {}
+    for family, device, package in select_devices(args.devices, args.all_devices):
+        corpus = os.path.join(workdir, "corpus", device)
+        out = os.path.join(workdir, "out", device)
+        os.makedirs(corpus)
+        os.makedirs(out)
+        runner.run(["tanggen", "--db", db, "--device", device, "--package", package, "--count", str(args.count),
+                    "--content", args.content, "-o", corpus])
+        names = ["{}_{}".format(device, seed) for seed in range(1, args.count + 1)]
+        bits = [os.path.join(corpus, name + ".bit") for name in names]
+        configs = [os.path.join(out, name + ".config") for name in names]
+        stages = {
+            "tangbit": [["tangbit", "--db", db, "--input", bit, "--bit", os.path.join(out, name + ".bit")]
+                        for name, bit in zip(names, bits)],
+            "tangunpack": [["tangunpack", "--db", db, bit, config] for bit, config in zip(bits, configs)],
+            "tangpack": [["tangpack", "--db", db, config, os.path.join(out, name + ".packed.bit")]
+                         for name, config in zip(names, configs)],
+        }
+        # Throughput is of the bitstream each stage reads or writes, so the stages can be compared with each other
+        total_bytes = sum(os.path.getsize(bit) for bit in bits)
+        results[device] = {"family": family}
+        for stage, runs in stages.items():
+            result = runner.measure(runs, args.repeat)
+            result["mb_per_s"] = total_bytes / result["seconds"] / 1e6
+            results[device][stage] = result
+            print("{:12s} {:12s} {:8.3f} s {:8.2f} MB/s {:8d} KiB {:>10s} allocs".format(
+                device, stage, result["seconds"], result["mb_per_s"], result["peak_rss_kb"],
+                "-" if result["allocations"] is None else str(result["allocations"])), flush=True)
+    return results
+
+
+def compare(baseline, current, args):
+    """Return a description of every regression of current against baseline"""
+    regressions = []
+
+    def check(what, base, value, tolerance, higher_is_better):
+        if base is None or value is None or base == 0:
+            return
+        change = value / base - 1
+        if (higher_is_better and -change > tolerance) or (not higher_is_better and change > tolerance):
+            regressions.append("{}: {:.4g} -> {:.4g} ({:+.1f}%)".format(what, base, value, change * 100))
+
+    for device, stages in baseline["results"].items():
+        if device not in current:
+            regressions.append("{}: missing from this run".format(device))
+            continue
+        for stage, base in stages.items():
+            if stage == "family":
+                continue
+            value = current[device][stage]
+            name = "{} {}".format(device, stage)
+            check(name + " throughput", base["mb_per_s"], value["mb_per_s"], args.tolerance, True)
+            check(name + " peak RSS", base["peak_rss_kb"], value["peak_rss_kb"], args.memory_tolerance, False)
+            check(name + " allocations", base["allocations"], value["allocations"], args.memory_tolerance, False)
+    return regressions
+
+
+def main(args):
+    corpus_options = {"count": args.count, "content": args.content, "all_devices": args.all_devices}
+    baseline = None
+    if not args.update:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get("version") != baseline_version or baseline.get("corpus") != corpus_options:
+            print("Baseline {} was made with a different version or corpus, rerun with --update".format(
+                args.baseline), file=sys.stderr)
+            return 2
+
+    workdir = args.workdir if args.workdir is not None else tempfile.mkdtemp(prefix="tang_regress_")
+    try:
+        if args.workdir is not None:
+            os.makedirs(workdir, exist_ok=True)
+            for name in work_subdirs:
+                shutil.rmtree(os.path.join(workdir, name), ignore_errors=True)
+            for name in work_files:
+                if os.path.exists(os.path.join(workdir, name)):
+                    os.remove(os.path.join(workdir, name))
+        runner = Runner(args.bindir, args.prefix, workdir)
+        if runner.alloc_file is None:
+            print("libtangalloccount.so not found, allocations are not counted", file=sys.stderr)
+        current = run_stages(runner, args, workdir)
+    except ToolError as e:
+        print(e, file=sys.stderr)
+        return 2
+    finally:
+        if args.workdir is None:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    if args.update:
+        with open(args.baseline, "w") as f:
+            json.dump({"version": baseline_version, "corpus": corpus_options, "results": current}, f, indent=2,
+                      sort_keys=True)
+            f.write("\n")
+        print("Wrote baseline {}".format(args.baseline))
+        return 0
+
+    regressions = compare(baseline, current, args)
+    for r in regressions:
+        print("REGRESSION " + r, file=sys.stderr)
+    if not regressions:
+        print("No regressions against {}".format(args.baseline))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,370 @@
+#include "BitDatabase.hpp"
+#include "Bitstream.hpp"
+#include "Chip.hpp"
+#include "CRAM.hpp"
+#include "Database.hpp"
+#include "Tile.hpp"
+#include "TileConfig.hpp"
+#include "Util.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+#include <chrono>
+#include <functional>
+#include <random>
+#ifndef NO_THREADS
+#include <thread>
+#endif
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+// Geometry of the synthetic device, the same as eagle_s20
+static const int bench_frames = 1259;
+static const int bench_bits_per_frame = 3904;
+static const int bench_cols = 41;
+static const int bench_rows = 72;
+static const int tile_frames = 30;
+static const int tile_bits = 54;
+static const char *bench_tile_types[] = {"plb", "emb", "iol"};
+
+static string config_bit(int frame, int bit, bool inverted = false)
+{
+    return string(inverted ? "!" : "") + "F" + to_string(frame) + "B" + to_string(bit);
+}
+
+// Write a database with one device and a few tile types, shaped like a real one, so the benchmarks need no vendor
+// database
+static void write_bench_database(const fs::path &root)
+{
+    fs::create_directories(root / "bench" / "bench_dev");
+    {
+        ofstream devices((root / "devices.json").string());
+        devices << "{\"families\": {\"bench\": {\"devices\": {\"bench_dev\": {"
+                << "\"packages\": {\"PKG\": {\"part\": \"BENCH\", \"idcode\": \"0x0b000001\"}}, "
+                << "\"frames\": " << bench_frames << ", \"bits_per_frame\": " << bench_bits_per_frame << ", "
+                << "\"bram_bits_per_frame\": 9216, \"max_row\": " << bench_rows << ", \"max_col\": " << bench_cols
+                << "}}}}}" << endl;
+    }
+    {
+        ofstream tilegrid((root / "bench" / "bench_dev" / "tilegrid.json").string());
+        tilegrid << "{";
+        for (int x = 0; x < bench_cols; x++) {
+            for (int y = 0; y < bench_rows; y++) {
+                string type = bench_tile_types[(x == 0) ? 2 : ((x % 10 == 5) ? 1 : 0)];
+                tilegrid << ((x || y) ? ", " : "") << "\"" << type << "_x" << x << "y" << y << "\": {\"x\": " << x
+                         << ", \"y\": " << y << ", \"rows\": " << tile_frames << ", \"cols\": " << tile_bits
+                         << ", \"start_bit\": " << y * tile_bits << ", \"start_frame\": " << x * tile_frames
+                         << ", \"type\": \"" << type << "\", \"flag\": 0}";
+            }
+        }
+        tilegrid << "}" << endl;
+    }
+    for (const char *type : bench_tile_types) {
+        fs::path dir = root / "bench" / "tiledata" / type;
+        fs::create_directories(dir);
+        ofstream bits((dir / "bits.db").string());
+        bits << "# Routing Mux Bits" << endl;
+        for (int m = 0; m < 12; m++) {
+            bits << ".mux W" << m << "_" << type << endl;
+            for (int s = 0; s < 6; s++) {
+                bits << "S" << s << "_" << m << " " << config_bit(m * 2, (s * 3) % tile_bits) << " "
+                     << config_bit(m * 2 + 1, (s * 5 + 1) % tile_bits);
+                if (s % 2)
+                    bits << " " << config_bit(m * 2, 40 + s);
+                bits << endl;
+            }
+            bits << "OFF -" << endl << endl;
+        }
+        bits << "# Non-Routing Configuration" << endl;
+        for (int w = 0; w < 4; w++) {
+            bits << ".config LUT" << w << "_INIT " << string(16, '0') << endl;
+            for (int i = 0; i < 16; i++)
+                bits << config_bit(24 + w, i, i == 0) << endl;
+            bits << endl;
+        }
+        bits << ".config_enum MODE NORMAL" << endl << "NORMAL -" << endl << "FAST F28B20" << endl
+             << "SLOW F28B21 F28B22" << endl << endl;
+        bits << "# Fixed Connections" << endl << ".fixed_conn Q0 F0" << endl << ".fixed_conn Q1 F1" << endl;
+    }
+}
+
+// Fill a tile with a random selection of the settings in a database
+static void random_tile(const Tang::FrozenTileBitDatabase &db, mt19937 &rng, Tang::CRAMView &tile)
+{
+    for (const auto *mux : db.get_muxes()) {
+        if (rng() % 3 != 0 || mux->arcs.empty())
+            continue;
+        auto arc = mux->arcs.begin();
+        advance(arc, rng() % mux->arcs.size());
+        arc->second.bits.set_group(tile);
+    }
+    for (const auto *word : db.get_words()) {
+        for (const auto &bits : word->bits) {
+            if (rng() % 2 == 0)
+                bits.set_group(tile);
+        }
+    }
+    for (const auto *senum : db.get_enums()) {
+        if (rng() % 2 != 0 || senum->options.empty())
+            continue;
+        auto opt = senum->options.begin();
+        advance(opt, rng() % senum->options.size());
+        opt->second.set_group(tile);
+    }
+}
+
+struct BenchResult
+{
+    string name;
+    string unit;
+    size_t iterations;
+    double seconds;
+    double bytes;
+    double items;
+};
+
+// Run fn until at least min_seconds have passed, each call processing bytes and items
+static BenchResult run_bench(const string &name, const string &unit, double bytes, double items, double min_seconds,
+                             const function<void()> &fn)
+{
+    BenchResult result{name, unit, 0, 0, 0, 0};
+    auto start = chrono::steady_clock::now();
+    do {
+        fn();
+        result.iterations++;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (result.seconds < min_seconds);
+    result.bytes = bytes * result.iterations;
+    result.items = items * result.iterations;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace Tang;
+    namespace po = boost::program_options;
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("filter", po::value<std::string>(), "only run benchmarks whose name contains this");
+    options.add_options()("min-time", po::value<double>()->default_value(0.5), "minimum seconds to run each benchmark");
+    options.add_options()("threads", po::value<int>()->default_value(4), "threads for the contended benchmarks");
+    options.add_options()("seed", po::value<unsigned>()->default_value(1), "random seed");
+    options.add_options()("json", "print results as JSON");
+
+    po::variables_map vm;
+    try {
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Tang - Open Source Tools for Anlogic FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": libtang microbenchmarks" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " [options]" << endl;
+        cerr << "Runs on a synthetic device and database written to a temporary directory, so no vendor database is"
+             << endl << "needed" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    string filter = vm.count("filter") ? vm["filter"].as<string>() : "";
+    double min_seconds = vm["min-time"].as<double>();
+    int num_threads = max(vm["threads"].as<int>(), 1);
+    mt19937 rng(vm["seed"].as<unsigned>());
+    vector<BenchResult> results;
+    auto bench = [&](const string &name, const string &unit, double bytes, double items, const function<void()> &fn) {
+        if (name.find(filter) == string::npos)
+            return;
+        results.push_back(run_bench(name, unit, bytes, items, min_seconds, fn));
+    };
+
+    // The bitstream reader reports every command it sees, which is not what is being measured
+    verbosity = VerbosityLevel::ERROR;
+    fs::path db_root = fs::temp_directory_path() / fs::unique_path("tangbench-%%%%-%%%%-%%%%");
+    try {
+        write_bench_database(db_root);
+        load_database(db_root.string());
+
+        // A chip with every tile given random settings, as a placed design would have
+        Chip chip(0x0b000001);
+        chip.metadata.push_back("# Synthetic bitstream for benchmarking");
+        for (const auto &tile : chip.tiles) {
+            auto db = get_tile_bitdata(TileLocator(tile.second->info.family, tile.second->info.device,
+                                                   tile.second->info.type))->freeze();
+            random_tile(*db, rng, tile.second->cram);
+        }
+        size_t frame_bytes = size_t(chip.cram.bits() / 8);
+        double cram_bytes = double(frame_bytes) * chip.cram.frames();
+
+        vector<uint8_t> random_bytes(1 << 20);
+        for (auto &b : random_bytes)
+            b = uint8_t(rng());
+        bench("crc16", "bytes", random_bytes.size(), random_bytes.size(), [&]() {
+            volatile uint16_t crc = Bitstream::crc16(random_bytes.data(), random_bytes.size());
+            (void)crc;
+        });
+
+        vector<uint8_t> packed(frame_bytes * chip.cram.frames());
+        bench("frame_pack", "frames", cram_bytes, chip.cram.frames(), [&]() {
+            for (int f = 0; f < chip.cram.frames(); f++)
+                Bitstream::pack_frame(chip, f, packed.data() + f * frame_bytes);
+        });
+        Chip unpacked(chip.info);
+        bench("frame_unpack", "frames", cram_bytes, chip.cram.frames(), [&]() {
+            unpacked.occupancy = CRAMOccupancy(unpacked.cram.frames(), unpacked.cram.bits());
+            for (int f = 0; f < chip.cram.frames(); f++)
+                Bitstream::unpack_frame(unpacked, f, packed.data() + f * frame_bytes, frame_bytes);
+            unpacked.occupancy.finalise(unpacked.cram);
+        });
+
+        ostringstream bit_stream;
+        Bitstream::serialise_chip(chip, {}).write_bit(bit_stream);
+        string bit_data = bit_stream.str();
+        bench("bitstream_read", "bytes", bit_data.size(), bit_data.size(), [&]() {
+            istringstream in(bit_data);
+            Bitstream::read(in);
+        });
+        istringstream bit_in(bit_data);
+        Bitstream bitstream = Bitstream::read(bit_in);
+        bench("deserialise_chip", "frames", cram_bytes, chip.cram.frames(), [&]() {
+            bitstream.deserialise_chip();
+        });
+        bench("serialise_chip", "frames", cram_bytes, chip.cram.frames(), [&]() {
+            Bitstream::serialise_chip(chip, {});
+        });
+
+        // Throughput of the writers is measured by their output
+        map<string, function<void(ostream &)>> writers = {
+                {"write_bit", [&](ostream &out) { bitstream.write_bit(out); }},
+                {"write_bin", [&](ostream &out) { bitstream.write_bin(out); }},
+                {"write_bas", [&](ostream &out) { bitstream.write_bas(out); }},
+                {"write_bmk", [&](ostream &out) { bitstream.write_bmk(chip, out); }},
+                {"write_bma", [&](ostream &out) { bitstream.write_bma(chip, out); }},
+                {"write_rbf", [&](ostream &out) { bitstream.write_rbf(out); }},
+                {"write_svf", [&](ostream &out) { bitstream.write_svf(chip, out); }},
+                {"write_fuse", [&](ostream &out) { Bitstream::write_fuse(chip, out); }},
+                {"write_chip_bit", [&](ostream &out) { Bitstream::write_chip_bit(chip, {}, out); }},
+        };
+        for (const auto &writer : writers) {
+            ostringstream sizing;
+            writer.second(sizing);
+            double size = sizing.str().size();
+            bench(writer.first, "bytes", size, size, [&]() {
+                ostringstream out;
+                writer.second(out);
+            });
+        }
+
+        TileLocator plb_loc("bench", "bench_dev", "plb");
+        auto plb_db = get_tile_bitdata(plb_loc);
+        auto plb_frozen = plb_db->freeze();
+        vector<CRAM> tiles;
+        for (int i = 0; i < 1000; i++) {
+            tiles.emplace_back(tile_frames, tile_bits);
+            CRAMView view = tiles.back().make_view(0, 0, tile_frames, tile_bits);
+            random_tile(*plb_frozen, rng, view);
+        }
+        double tile_bytes = double(tile_frames) * tile_bits / 8 * tiles.size();
+
+        vector<const BitGroup *> groups;
+        for (const auto *mux : plb_frozen->get_muxes())
+            for (const auto &arc : mux->arcs)
+                groups.push_back(&arc.second.bits);
+        for (const auto *senum : plb_frozen->get_enums())
+            for (const auto &opt : senum->options)
+                groups.push_back(&opt.second);
+        bench("bitgroup_match", "matches", tile_bytes, double(tiles.size() * groups.size()), [&]() {
+            size_t matched = 0;
+            for (auto &tile : tiles) {
+                CRAMView view = tile.make_view(0, 0, tile_frames, tile_bits);
+                for (const auto *group : groups)
+                    matched += group->match(view);
+            }
+            volatile size_t sink = matched;
+            (void)sink;
+        });
+
+        vector<TileConfig> configs(tiles.size());
+        bench("tile_cram_to_config", "tiles", tile_bytes, tiles.size(), [&]() {
+            for (size_t i = 0; i < tiles.size(); i++)
+                configs[i] = plb_db->tile_cram_to_config(tiles[i].make_view(0, 0, tile_frames, tile_bits));
+        });
+        vector<CRAM> encoded;
+        for (size_t i = 0; i < tiles.size(); i++)
+            encoded.emplace_back(tile_frames, tile_bits);
+        bench("config_to_tile_cram", "tiles", tile_bytes, tiles.size(), [&]() {
+            for (size_t i = 0; i < tiles.size(); i++) {
+                CRAMView view = encoded[i].make_view(0, 0, tile_frames, tile_bits);
+                plb_db->config_to_tile_cram(configs[i], view);
+            }
+        });
+
+        vector<TileLocator> locators;
+        for (const char *type : bench_tile_types)
+            locators.push_back(TileLocator("bench", "bench_dev", type));
+        const size_t lookups_per_thread = 100000;
+        bench("get_tile_bitdata_contended", "lookups", 0, double(lookups_per_thread) * num_threads, [&]() {
+            auto lookups = [&](size_t first) {
+                for (size_t i = 0; i < lookups_per_thread; i++)
+                    get_tile_bitdata(locators[(first + i) % locators.size()]);
+            };
+#ifdef NO_THREADS
+            for (int t = 0; t < num_threads; t++)
+                lookups(size_t(t));
+#else
+            // A fresh set of threads each time, so the per-thread caches start empty as they would in a tool
+            vector<thread> workers;
+            for (int t = 0; t < num_threads; t++)
+                workers.emplace_back(lookups, size_t(t));
+            for (auto &worker : workers)
+                worker.join();
+#endif
+        });
+    } catch (BitstreamParseError &e) {
+        cerr << "Error: " << e.what() << endl;
+        fs::remove_all(db_root);
+        return 1;
+    } catch (exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        fs::remove_all(db_root);
+        return 1;
+    }
+    fs::remove_all(db_root);
+
+    if (vm.count("json")) {
+        cout << "{\"benchmarks\": [" << endl;
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto &r = results[i];
+            cout << "  {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations << ", \"seconds\": "
+                 << r.seconds << ", \"mb_per_s\": " << r.bytes / r.seconds / 1e6 << ", \"items_per_s\": "
+                 << r.items / r.seconds << ", \"unit\": \"" << r.unit << "\"}" << ((i + 1 < results.size()) ? "," : "")
+                 << endl;
+        }
+        cout << "]}" << endl;
+    } else {
+        cout << left << setw(28) << "benchmark" << right << setw(12) << "iterations" << setw(12) << "MB/s"
+             << setw(16) << "items/s" << "  unit" << endl;
+        for (const auto &r : results) {
+            cout << left << setw(28) << r.name << right << setw(12) << r.iterations << fixed << setprecision(1)
+                 << setw(12) << r.bytes / r.seconds / 1e6 << setw(16) << r.items / r.seconds << "  " << r.unit
+                 << endl;
+        }
+    }
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <streambuf>
 #include "version.hpp"
 #include "wasmexcept.hpp"
+#include "toolstats.hpp"
 #include "Bitstream.hpp"
 #include "Chip.hpp"
 #include "Database.hpp"
@@ -30,6 +31,8 @@ int main(int argc, char *argv[])
     options.add_options()("svf", po::value<std::string>(), "output svf file");
     options.add_options()("rbf", po::value<std::string>(), "output rbf file");
     options.add_options()("db", po::value<std::string>(), "Tang database folder location");
+    options.add_options()("stats", po::value<std::string>()->implicit_value("text"),
+                          "print phase times and counters to stderr on exit, as text or with --stats=json");
 
     po::positional_options_description pos;
     options.add_options()("input", po::value<std::string>()->required(), "input bitstream file");
@@ -37,7 +40,8 @@ int main(int argc, char *argv[])
 
     po::variables_map vm;
     try {
-        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos).run();
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos)
+                .extra_parser(stats_parser).run();
         po::store(parsed, vm);
         po::notify(vm);
     } catch (std::exception &e) {
@@ -57,6 +61,11 @@ int main(int argc, char *argv[])
         return vm.count("help") ? 0 : 1;
     }
 
+    if (vm.count("stats") && !enable_stats(vm["stats"].as<string>())) {
+        cerr << "Error: --stats format must be text or json" << endl << endl;
+        goto help;
+    }
+
     ifstream bitstream_file(vm["input"].as<string>());
     if (!bitstream_file) {
         cerr << "Failed to open input file" << endl;
@@ -0,0 +1,77 @@
+#include "ChipConfig.hpp"
+#include "ChipConfigBinary.hpp"
+#include "Scanner.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <stdexcept>
+#include <fstream>
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    using namespace Tang;
+    namespace po = boost::program_options;
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    po::positional_options_description pos;
+    options.add_options()("input", po::value<std::string>()->required(), "input configuration");
+    pos.add("input", 1);
+    options.add_options()("output", po::value<std::string>()->required(), "output configuration");
+    pos.add("output", 1);
+
+    po::variables_map vm;
+    try {
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }
+    catch (po::required_option &e) {
+        cerr << "Error: input and output files are mandatory." << endl << endl;
+        goto help;
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Tang - Open Source Tools for Anlogic FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": text and binary config converter" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " input.config output.config [options]" << endl;
+        cerr << "A textual input is written in the binary format, and a binary input as text" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    string input;
+    if (!read_file(vm["input"].as<string>(), input)) {
+        cerr << "Failed to open input file" << endl;
+        return 1;
+    }
+
+    try {
+        bool binary = BinaryChipConfig::is_binary(input.data(), input.data() + input.size());
+        string output;
+        if (binary)
+            output = BinaryChipConfig(input.data(), input.data() + input.size()).decode().to_string();
+        else
+            output = BinaryChipConfig::encode(ChipConfig::from_string(input));
+        ofstream out_file(vm["output"].as<string>(), binary ? ios::out : ios::out | ios::binary);
+        if (!out_file) {
+            cerr << "Failed to open output file" << endl;
+            return 1;
+        }
+        out_file << output;
+    } catch (runtime_error &e) {
+        cerr << "Failed to convert input config: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "BitDatabase.hpp"
+#include "CRAM.hpp"
+#include "Database.hpp"
+#include "DatabasePath.hpp"
+#include "TileCodec.hpp"
+#include "TileConfig.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <iostream>
+#include <iomanip>
+#include <boost/program_options.hpp>
+#include <stdexcept>
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+// Fill a tile with a random selection of the settings in a database, plus some stray bits
+static void random_tile(const Tang::FrozenTileBitDatabase &db, mt19937 &rng, Tang::CRAMView &tile)
+{
+    for (const auto *mux : db.get_muxes()) {
+        if (rng() % 3 != 0 || mux->arcs.empty())
+            continue;
+        auto arc = mux->arcs.begin();
+        advance(arc, rng() % mux->arcs.size());
+        arc->second.bits.set_group(tile);
+    }
+    for (const auto *word : db.get_words()) {
+        for (const auto &bits : word->bits) {
+            if (rng() % 2 == 0)
+                bits.set_group(tile);
+        }
+    }
+    for (const auto *senum : db.get_enums()) {
+        if (rng() % 2 != 0 || senum->options.empty())
+            continue;
+        auto opt = senum->options.begin();
+        advance(opt, rng() % senum->options.size());
+        opt->second.set_group(tile);
+    }
+    for (int i = 0; i < 4; i++)
+        tile.bit(int(rng() % tile.frames()), int(rng() % tile.bits())) = 1;
+}
+
+template <typename Fn> static double time_ms(Fn fn)
+{
+    auto start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace Tang;
+    namespace po = boost::program_options;
+
+    std::string database_folder = get_database_path();
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("db", po::value<std::string>(), "Tang database folder location");
+    options.add_options()("tiles", po::value<int>()->default_value(1000), "random tiles per tile type");
+    options.add_options()("seed", po::value<unsigned>()->default_value(1), "random seed");
+
+    po::variables_map vm;
+    try {
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Tang - Open Source Tools for Anlogic FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": generated tile codec benchmark" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " [options]" << endl;
+        cerr << "Compares the generated codecs against the generic path on random tiles, exit status is 1 if they"
+             << endl << "give different results or a codec could not be checked" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 2;
+    }
+
+    if (vm.count("db")) {
+        database_folder = vm["db"].as<string>();
+    }
+
+    try {
+        load_database(database_folder);
+    } catch (runtime_error &e) {
+        cerr << "Failed to load Tang database: " << e.what() << endl;
+        return 2;
+    }
+
+    int tile_count = vm["tiles"].as<int>();
+    mt19937 rng(vm["seed"].as<unsigned>());
+    bool mismatch = false;
+    try {
+        for (const TileCodec *codec : get_tile_codecs()) {
+            // The device is not needed to find the bit database
+            auto db = get_tile_bitdata(TileLocator(codec->family, "", codec->tile_type))->freeze();
+            // Identical databases share a codec, so the one in use is recognised by its hash
+            if (db->get_codec() == nullptr || db->get_codec()->db_hash != codec->db_hash) {
+                cout << codec->family << " " << codec->tile_type
+                     << ": database has changed since the codec was generated" << endl;
+                mismatch = true;
+                continue;
+            }
+            int frames = max(codec->frames, 1), bits = max(codec->bits, 1);
+            vector<CRAM> tiles;
+            for (int i = 0; i < tile_count; i++) {
+                tiles.emplace_back(frames, bits);
+                CRAMView view = tiles.back().make_view(0, 0, frames, bits);
+                random_tile(*db, rng, view);
+            }
+
+            vector<TileConfig> generic_cfgs(tiles.size()), codec_cfgs(tiles.size());
+            set_tile_codecs_enabled(false);
+            double generic_decode = time_ms([&]() {
+                for (size_t i = 0; i < tiles.size(); i++)
+                    generic_cfgs[i] = db->tile_cram_to_config(tiles[i].make_view(0, 0, frames, bits));
+            });
+            set_tile_codecs_enabled(true);
+            double codec_decode = time_ms([&]() {
+                for (size_t i = 0; i < tiles.size(); i++)
+                    codec_cfgs[i] = db->tile_cram_to_config(tiles[i].make_view(0, 0, frames, bits));
+            });
+
+            vector<CRAM> generic_tiles, codec_tiles;
+            for (size_t i = 0; i < tiles.size(); i++) {
+                generic_tiles.emplace_back(frames, bits);
+                codec_tiles.emplace_back(frames, bits);
+            }
+            set_tile_codecs_enabled(false);
+            double generic_encode = time_ms([&]() {
+                for (size_t i = 0; i < tiles.size(); i++) {
+                    CRAMView view = generic_tiles[i].make_view(0, 0, frames, bits);
+                    db->config_to_tile_cram(generic_cfgs[i], view);
+                }
+            });
+            set_tile_codecs_enabled(true);
+            double codec_encode = time_ms([&]() {
+                for (size_t i = 0; i < tiles.size(); i++) {
+                    CRAMView view = codec_tiles[i].make_view(0, 0, frames, bits);
+                    db->config_to_tile_cram(generic_cfgs[i], view);
+                }
+            });
+
+            size_t differences = 0;
+            for (size_t i = 0; i < tiles.size(); i++) {
+                CRAMView a = generic_tiles[i].make_view(0, 0, frames, bits);
+                CRAMView b = codec_tiles[i].make_view(0, 0, frames, bits);
+                if (generic_cfgs[i].to_string() != codec_cfgs[i].to_string() || !(a - b).empty())
+                    differences++;
+            }
+            cout << codec->family << " " << codec->tile_type << ": " << tile_count << " tiles, decode " << fixed
+                 << setprecision(1) << generic_decode << " ms generic, " << codec_decode << " ms generated; encode "
+                 << generic_encode << " ms generic, " << codec_encode << " ms generated";
+            if (differences > 0) {
+                cout << "; " << differences << " tiles differ";
+                mismatch = true;
+            }
+            cout << endl;
+        }
+    } catch (out_of_range &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    } catch (runtime_error &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    }
+    return mismatch ? 1 : 0;
+}
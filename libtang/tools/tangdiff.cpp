@@ -0,0 +1,133 @@
+#include "BitstreamDiff.hpp"
+#include "Bitstream.hpp"
+#include "Chip.hpp"
+#include "Database.hpp"
+#include "DatabasePath.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static void print_bit(const Tang::ChangedBit &bit)
+{
+    cout << "  F" << bit.frame << "B" << bit.bit << ": " << (bit.delta > 0 ? "1 -> 0" : "0 -> 1") << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace Tang;
+    namespace po = boost::program_options;
+
+    std::string database_folder = get_database_path();
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("db", po::value<std::string>(), "Tang database folder location");
+    options.add_options()("decode", "decode changed tiles and show arc, word and enum differences");
+    options.add_options()("equivalence", "ignore metadata, only check the configuration is equivalent");
+    options.add_options()("quiet,q", "only report whether the bitstreams differ");
+    po::positional_options_description pos;
+    options.add_options()("first", po::value<std::string>()->required(), "first bitstream file");
+    pos.add("first", 1);
+    options.add_options()("second", po::value<std::string>()->required(), "second bitstream file");
+    pos.add("second", 1);
+
+    po::variables_map vm;
+    try {
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }
+    catch (po::required_option &e) {
+        cerr << "Error: two input files are mandatory." << endl << endl;
+        goto help;
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Tang - Open Source Tools for Anlogic FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": Anlogic bitstream comparison tool" << endl;
+        cerr << endl;
+        cerr << "Copyright (C) 2021 Miodrag Milanovic <mmicko@gmail.com>" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " first.bit second.bit [options]" << endl;
+        cerr << "Exit status is 0 if the bitstreams match, 1 if they differ and 2 on error" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 2;
+    }
+
+    ifstream first_file(vm["first"].as<string>(), ios::binary);
+    if (!first_file) {
+        cerr << "Failed to open first input file" << endl;
+        return 2;
+    }
+    ifstream second_file(vm["second"].as<string>(), ios::binary);
+    if (!second_file) {
+        cerr << "Failed to open second input file" << endl;
+        return 2;
+    }
+
+    if (vm.count("db")) {
+        database_folder = vm["db"].as<string>();
+    }
+
+    try {
+        load_database(database_folder);
+    } catch (runtime_error &e) {
+        cerr << "Failed to load Tang database: " << e.what() << endl;
+        return 2;
+    }
+
+    try {
+        Chip a = Bitstream::read(first_file).deserialise_chip();
+        Chip b = Bitstream::read(second_file).deserialise_chip();
+        DiffOptions diff_opts;
+        diff_opts.ignore_metadata = vm.count("equivalence") > 0;
+        diff_opts.decode_tiles = vm.count("decode") > 0;
+        ChipDiff diff = diff_chips(a, b, diff_opts);
+        if (vm.count("quiet"))
+            return diff.empty() ? 0 : 1;
+        for (const auto &other : diff.other)
+            cout << other << endl;
+        for (const auto &tile : diff.tiles) {
+            cout << "tile " << tile.first << " (" << tile.second.type << "): " << tile.second.bits.size()
+                 << " bits changed" << endl;
+            for (const auto &bit : tile.second.bits)
+                print_bit(bit);
+            if (diff_opts.decode_tiles) {
+                stringstream removed(tile.second.removed.to_string()), added(tile.second.added.to_string());
+                string line;
+                while (getline(removed, line))
+                    cout << "  - " << line << endl;
+                while (getline(added, line))
+                    cout << "  + " << line << endl;
+            }
+        }
+        if (!diff.unowned_bits.empty()) {
+            cout << "bits outside tiles: " << diff.unowned_bits.size() << " bits changed" << endl;
+            for (const auto &bit : diff.unowned_bits)
+                print_bit(bit);
+        }
+        if (diff.empty())
+            cout << (diff_opts.ignore_metadata ? "bitstreams are equivalent" : "bitstreams match") << endl;
+        else
+            cout << diff.changed_frames.size() << " frames differ" << endl;
+        return diff.empty() ? 0 : 1;
+    } catch (BitstreamParseError &e) {
+        cerr << "Failed to process input bitstream: " << e.what() << endl;
+        return 2;
+    } catch (runtime_error &e) {
+        cerr << "Failed to compare bitstreams: " << e.what() << endl;
+        return 2;
+    }
+}
@@ -0,0 +1,166 @@
+#include "ChipConfig.hpp"
+#include "Chip.hpp"
+#include "Database.hpp"
+#include "DatabasePath.hpp"
+#include "DecodeCache.hpp"
+#include "Synthetic.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <iostream>
+#include <iomanip>
+#include <boost/program_options.hpp>
+#include <stdexcept>
+#include <fstream>
+#include <chrono>
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    using namespace Tang;
+    namespace po = boost::program_options;
+
+    std::string database_folder = get_database_path();
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("verbose,v", "verbose output");
+    options.add_options()("db", po::value<std::string>(), "Tang database folder location");
+    options.add_options()("make-db", po::value<std::string>(),
+                          "write a synthetic database for every device in devices.json to this folder and exit");
+    options.add_options()("devices", po::value<std::string>(), "devices.json for --make-db, default is the database's");
+    options.add_options()("device", po::value<std::string>(), "device name");
+    options.add_options()("package", po::value<std::string>(), "device package");
+    options.add_options()("count", po::value<int>()->default_value(1), "number of bitstreams");
+    options.add_options()("seed", po::value<uint64_t>()->default_value(1), "seed of the first bitstream");
+    options.add_options()("content", po::value<std::string>()->default_value("sparse"),
+                          "CRAM content: empty, sparse, random or structured");
+    options.add_options()("density", po::value<double>()->default_value(0.01), "fraction of bits set by sparse content");
+    options.add_options()("bram", po::value<int>()->default_value(0), "BRAM blocks given random payloads");
+    options.add_options()("pll", po::value<int>()->default_value(0), "PLLs given random payloads");
+    options.add_options()("corrupt", po::value<std::string>()->default_value("none"),
+                          "corruption: none, frame, crc or truncate");
+    options.add_options()("output,o", po::value<std::string>()->default_value("."), "output folder");
+    options.add_options()("config", "also write a text config for each bitstream");
+
+    po::variables_map vm;
+    try {
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Tang - Open Source Tools for Anlogic FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": synthetic bitstream generator" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " --device name --package package [options]" << endl;
+        cerr << "       " << argv[0] << " --make-db folder [options]" << endl;
+        cerr << "Bitstreams are written to the output folder as <device>_<seed>.bit" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    if (vm.count("db")) {
+        database_folder = vm["db"].as<string>();
+    }
+
+    if (vm.count("make-db")) {
+        string devices_file = vm.count("devices") ? vm["devices"].as<string>() : database_folder + "/devices.json";
+        try {
+            write_synthetic_database(vm["make-db"].as<string>(), devices_file);
+        } catch (exception &e) {
+            cerr << "Failed to write synthetic database: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!vm.count("device") || !vm.count("package")) {
+        cerr << "Error: device and package are mandatory." << endl << endl;
+        goto help;
+    }
+
+    SyntheticOptions opts;
+    string content = vm["content"].as<string>(), corrupt = vm["corrupt"].as<string>();
+    if (content == "empty")
+        opts.content = SyntheticContent::EMPTY;
+    else if (content == "sparse")
+        opts.content = SyntheticContent::SPARSE;
+    else if (content == "random")
+        opts.content = SyntheticContent::RANDOM;
+    else if (content == "structured")
+        opts.content = SyntheticContent::STRUCTURED;
+    else {
+        cerr << "Error: unknown content " << content << endl << endl;
+        goto help;
+    }
+    if (corrupt == "none")
+        opts.corruption = SyntheticCorruption::NONE;
+    else if (corrupt == "frame")
+        opts.corruption = SyntheticCorruption::FRAME;
+    else if (corrupt == "crc")
+        opts.corruption = SyntheticCorruption::CRC;
+    else if (corrupt == "truncate")
+        opts.corruption = SyntheticCorruption::TRUNCATE;
+    else {
+        cerr << "Error: unknown corruption " << corrupt << endl << endl;
+        goto help;
+    }
+    opts.density = vm["density"].as<double>();
+    opts.bram_blocks = vm["bram"].as<int>();
+    opts.plls = vm["pll"].as<int>();
+
+    try {
+        load_database(database_folder);
+    } catch (exception &e) {
+        cerr << "Failed to load Tang database: " << e.what() << endl;
+        return 1;
+    }
+
+    string device = vm["device"].as<string>(), output = vm["output"].as<string>();
+    int count = vm["count"].as<int>();
+    uint64_t first_seed = vm["seed"].as<uint64_t>();
+    size_t total_bytes = 0;
+    auto start = chrono::steady_clock::now();
+    try {
+        SyntheticGenerator gen(find_device_by_name(device, vm["package"].as<string>()), opts);
+        TileDecodeCache cache;
+        for (int i = 0; i < count; i++) {
+            uint64_t seed = first_seed + uint64_t(i);
+            string name = output + "/" + device + "_" + to_string(seed);
+            string bit = gen.make_bitstream(seed);
+            ofstream bit_file(name + ".bit", ios::binary);
+            if (!bit_file) {
+                cerr << "Failed to open output file " << name << ".bit" << endl;
+                return 1;
+            }
+            bit_file.write(bit.data(), bit.size());
+            total_bytes += bit.size();
+            if (vm.count("config")) {
+                // The chip for a seed is always the same, and is what was serialised before any corruption
+                ofstream cfg_file(name + ".config");
+                if (!cfg_file) {
+                    cerr << "Failed to open output file " << name << ".config" << endl;
+                    return 1;
+                }
+                cfg_file << ChipConfig::from_chip(gen.make_chip(seed), cache).to_string();
+            }
+        }
+    } catch (exception &e) {
+        cerr << "Failed to generate bitstreams: " << e.what() << endl;
+        return 1;
+    }
+    if (vm.count("verbose")) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << count << " bitstreams, " << total_bytes << " bytes in " << fixed << setprecision(3) << seconds
+             << " s, " << setprecision(1) << count / seconds << " files/s" << endl;
+    }
+    return 0;
+}
@@ -1,16 +1,21 @@
 #include "ChipConfig.hpp"
+#include "ChipConfigBinary.hpp"
+#include "PackCache.hpp"
 #include "Bitstream.hpp"
 #include "Chip.hpp"
 #include "Database.hpp"
+#include "Metrics.hpp"
 #include "DatabasePath.hpp"
 #include "Tile.hpp"
 #include "BitDatabase.hpp"
+#include "Scanner.hpp"
 #include "version.hpp"
 #include "wasmexcept.hpp"
+#include "toolstats.hpp"
 #include <iostream>
+#include <boost/optional.hpp>
 #include <boost/program_options.hpp>
 #include <stdexcept>
-#include <streambuf>
 #include <fstream>
 #include <iomanip>
 
@@ -28,8 +33,13 @@ int main(int argc, char *argv[])
     options.add_options()("verbose,v", "verbose output");
     options.add_options()("db", po::value<std::string>(), "Tang database folder location");
     options.add_options()("usercode", po::value<uint32_t>(), "USERCODE to set in bitstream");
+    options.add_options()("binary", "input configuration is in the binary format");
+    options.add_options()("pipeline", "build the chip while parsing the input and stream frames to the output");
+    options.add_options()("cache", po::value<std::string>(), "reuse unchanged frames from, and update, a cache of the last pack");
+    options.add_options()("stats", po::value<std::string>()->implicit_value("text"),
+                          "print phase times and counters to stderr on exit, as text or with --stats=json");
     po::positional_options_description pos;
-    options.add_options()("input", po::value<std::string>()->required(), "input textual configuration");
+    options.add_options()("input", po::value<std::string>()->required(), "input configuration");
     pos.add("input", 1);
     options.add_options()("bit", po::value<std::string>(), "output bitstream file");
     pos.add("bit", 1);
@@ -37,7 +47,8 @@ int main(int argc, char *argv[])
     po::variables_map vm;
 
     try {
-        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos).run();
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos)
+                .extra_parser(stats_parser).run();
         po::store(parsed, vm);
         po::notify(vm);
     }
@@ -63,11 +74,17 @@ help:
         return vm.count("help") ? 0 : 1;
     }
 
-    ifstream config_file(vm["input"].as<string>());
-    if (!config_file) {
+    if (vm.count("stats") && !enable_stats(vm["stats"].as<string>())) {
+        cerr << "Error: --stats format must be text or json" << endl << endl;
+        goto help;
+    }
+
+    string textcfg;
+    if (!read_file(vm["input"].as<string>(), textcfg)) {
         cerr << "Failed to open input file" << endl;
         return 1;
     }
+    Metrics::add(Counter::BYTES_READ, textcfg.size());
 
     if (vm.count("db")) {
         database_folder = vm["db"].as<string>();
@@ -80,23 +97,68 @@ help:
         return 1;
     }
 
-    string textcfg((std::istreambuf_iterator<char>(config_file)), std::istreambuf_iterator<char>());
-
     ChipConfig cc;
+    boost::optional<Chip> c;
     try {
-        cc = ChipConfig::from_string(textcfg);
+        if (vm.count("binary"))
+            cc = BinaryChipConfig(textcfg.data(), textcfg.data() + textcfg.size()).decode();
+        else if (vm.count("pipeline"))
+            c.emplace(ChipConfig::text_to_chip(textcfg.data(), textcfg.data() + textcfg.size()));
+        else
+            cc = ChipConfig::from_string(textcfg);
     } catch (runtime_error &e) {
         cerr << "Failed to process input config: " << e.what() << endl;
         return 1;
     }
 
-    Chip c = cc.to_chip();
+    if (!c)
+        c.emplace(cc.to_chip());
     if (vm.count("usercode"))
-        c.usercode = vm["usercode"].as<uint32_t>();
+        c->usercode = vm["usercode"].as<uint32_t>();
 
     map<string, string> bitopts;
 
-    Bitstream b = Bitstream::serialise_chip(c, bitopts);
+    if (vm.count("cache")) {
+        string cache_file = vm["cache"].as<string>();
+        PackCache cache;
+        bool loaded = cache.load(cache_file);
+        string bit_data;
+        try {
+            bit_data = cache.pack(*c);
+            cache.save(cache_file);
+        } catch (runtime_error &e) {
+            cerr << "Failed to pack with cache: " << e.what() << endl;
+            return 1;
+        }
+        if (vm.count("verbose"))
+            cerr << (loaded ? "Using cache, " : "No usable cache, ") << cache.frames_reused() << " frames reused, "
+                 << cache.frames_encoded() << " encoded" << endl;
+        if (vm.count("bit")) {
+            ofstream bit_file(vm["bit"].as<string>(), ios::binary);
+            if (!bit_file) {
+                cerr << "Failed to open output file" << endl;
+                return 1;
+            }
+            PhaseTimer timer(Phase::WRITE);
+            bit_file.write(bit_data.data(), bit_data.size());
+            Metrics::add(Counter::BYTES_WRITTEN, bit_data.size());
+        }
+        return 0;
+    }
+
+    if (vm.count("pipeline")) {
+        if (vm.count("bit")) {
+            ofstream bit_file(vm["bit"].as<string>(), ios::binary);
+            if (!bit_file) {
+                cerr << "Failed to open output file" << endl;
+                return 1;
+            }
+            Bitstream::write_chip_bit(*c, bitopts, bit_file);
+        }
+        return 0;
+    }
+
+    Bitstream b = Bitstream::serialise_chip(*c, bitopts);
     if (vm.count("bit")) {
         ofstream bit_file(vm["bit"].as<string>(), ios::binary);
         if (!bit_file) {
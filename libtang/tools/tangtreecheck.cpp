@@ -0,0 +1,194 @@
+#include "BitDatabase.hpp"
+#include "CRAM.hpp"
+#include "Database.hpp"
+#include "DatabasePath.hpp"
+#include "TileCodec.hpp"
+#include "TileConfig.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+// Fill a tile with a random selection of the settings in a database, then flip some bits so that partial and
+// overlapping matches are exercised too
+static void random_tile(const Tang::FrozenTileBitDatabase &db, mt19937 &rng, Tang::CRAMView &tile)
+{
+    for (const auto *mux : db.get_muxes()) {
+        if (rng() % 2 != 0 || mux->arcs.empty())
+            continue;
+        auto arc = mux->arcs.begin();
+        advance(arc, rng() % mux->arcs.size());
+        arc->second.bits.set_group(tile);
+    }
+    for (const auto *senum : db.get_enums()) {
+        if (rng() % 2 != 0 || senum->options.empty())
+            continue;
+        auto opt = senum->options.begin();
+        advance(opt, rng() % senum->options.size());
+        opt->second.set_group(tile);
+    }
+    int flips = int(rng() % 16);
+    for (int i = 0; i < flips; i++) {
+        char &bit = tile.bit(int(rng() % tile.frames()), int(rng() % tile.bits()));
+        bit = !bit;
+    }
+}
+
+// Decode a tile by trying every candidate in turn, as was done before decision trees
+static Tang::TileConfig linear_decode(const Tang::FrozenTileBitDatabase &db, const Tang::CRAMView &tile)
+{
+    using namespace Tang;
+    TileConfig cfg;
+    BitSet coverage;
+    for (const auto *mux : db.get_muxes()) {
+        auto sink = mux->get_driver(tile, coverage);
+        if (sink && mux->arcs.at(*sink).bits.bits.size() > 0)
+            cfg.carcs.push_back(ConfigArc{mux->sink, *sink});
+    }
+    for (const auto *cw : db.get_words()) {
+        auto val = cw->get_value(tile, coverage);
+        if (val)
+            cfg.cwords.push_back(ConfigWord{cw->name, *val});
+    }
+    for (const auto *ce : db.get_enums()) {
+        auto val = ce->get_value(tile, coverage);
+        if (val)
+            cfg.cenums.push_back(ConfigEnum{ce->name, *val});
+    }
+    for (int f = 0; f < tile.frames(); f++) {
+        for (int b = 0; b < tile.bits(); b++) {
+            if (tile.get_bit(f, b)) {
+                if (coverage.find(ConfigBit{f, b, false}) == coverage.end())
+                    cfg.cunknowns.push_back(ConfigUnknown{f, b});
+                else
+                    cfg.total_known_bits++;
+            }
+        }
+    }
+    return cfg;
+}
+
+// Every tile type with a bit database, found by walking the database folder
+static vector<Tang::TileLocator> find_tile_types(const string &database_folder)
+{
+    namespace fs = boost::filesystem;
+    vector<Tang::TileLocator> result;
+    for (const auto &family : fs::directory_iterator(database_folder)) {
+        fs::path tiledata = family.path() / "tiledata";
+        if (!fs::is_directory(tiledata))
+            continue;
+        for (const auto &type : fs::directory_iterator(tiledata)) {
+            if (fs::exists(type.path() / "bits.db"))
+                result.push_back(Tang::TileLocator(family.path().filename().string(), "",
+                                                   type.path().filename().string()));
+        }
+    }
+    sort(result.begin(), result.end(), [](const Tang::TileLocator &a, const Tang::TileLocator &b) {
+        return make_pair(a.family, a.tiletype) < make_pair(b.family, b.tiletype);
+    });
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace Tang;
+    namespace po = boost::program_options;
+
+    std::string database_folder = get_database_path();
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("db", po::value<std::string>(), "Tang database folder location");
+    options.add_options()("tiles", po::value<int>()->default_value(1000), "random tiles per tile type");
+    options.add_options()("seed", po::value<unsigned>()->default_value(1), "random seed");
+
+    po::variables_map vm;
+    try {
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).run();
+        po::store(parsed, vm);
+        po::notify(vm);
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Tang - Open Source Tools for Anlogic FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": decision tree decoder check" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " [options]" << endl;
+        cerr << "Decodes random tiles of every tile type with the decision trees and with a linear scan of the"
+             << endl << "database, exit status is 1 if they give different results" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 2;
+    }
+
+    if (vm.count("db")) {
+        database_folder = vm["db"].as<string>();
+    }
+
+    try {
+        load_database(database_folder);
+    } catch (runtime_error &e) {
+        cerr << "Failed to load Tang database: " << e.what() << endl;
+        return 2;
+    }
+
+    int tile_count = vm["tiles"].as<int>();
+    mt19937 rng(vm["seed"].as<unsigned>());
+    bool mismatch = false;
+    // Generated codecs would bypass the trees
+    set_tile_codecs_enabled(false);
+    try {
+        for (const auto &type : find_tile_types(database_folder)) {
+            auto db = get_tile_bitdata(type)->freeze();
+            // The tile must cover every bit of the database, words included
+            int frames = 1, bits = 1;
+            auto cover = [&](const BitGroup &group) {
+                for (const auto &bit : group.bits) {
+                    frames = max(frames, bit.frame + 1);
+                    bits = max(bits, bit.bit + 1);
+                }
+            };
+            for (const auto *mux : db->get_muxes())
+                for (const auto &arc : mux->arcs)
+                    cover(arc.second.bits);
+            for (const auto *word : db->get_words())
+                for (const auto &group : word->bits)
+                    cover(group);
+            for (const auto *senum : db->get_enums())
+                for (const auto &opt : senum->options)
+                    cover(opt.second);
+            size_t differences = 0;
+            for (int i = 0; i < tile_count; i++) {
+                CRAM cram(frames, bits);
+                CRAMView tile = cram.make_view(0, 0, frames, bits);
+                random_tile(*db, rng, tile);
+                if (db->tile_cram_to_config(tile).to_string() != linear_decode(*db, tile).to_string())
+                    differences++;
+            }
+            cout << type.family << " " << type.tiletype << ": " << tile_count << " tiles";
+            if (differences > 0) {
+                cout << ", " << differences << " differ";
+                mismatch = true;
+            }
+            cout << endl;
+        }
+    } catch (out_of_range &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    } catch (runtime_error &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    }
+    return mismatch ? 1 : 0;
+}
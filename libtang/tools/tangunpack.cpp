@@ -1,10 +1,13 @@
 #include "ChipConfig.hpp"
+#include "ChipConfigBinary.hpp"
 #include "Bitstream.hpp"
 #include "Chip.hpp"
 #include "Database.hpp"
+#include "Metrics.hpp"
 #include "DatabasePath.hpp"
 #include "version.hpp"
 #include "wasmexcept.hpp"
+#include "toolstats.hpp"
 #include <iostream>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
@@ -25,15 +28,19 @@ int main(int argc, char *argv[])
     options.add_options()("help,h", "show help");
     options.add_options()("verbose,v", "verbose output");
     options.add_options()("db", po::value<std::string>(), "Tang database folder location");
+    options.add_options()("binary", "write the configuration in the binary format");
+    options.add_options()("stats", po::value<std::string>()->implicit_value("text"),
+                          "print phase times and counters to stderr on exit, as text or with --stats=json");
     po::positional_options_description pos;
     options.add_options()("input", po::value<std::string>()->required(), "input bitstream file");
     pos.add("input", 1);
-    options.add_options()("textcfg", po::value<std::string>()->required(), "output textual configuration");
+    options.add_options()("textcfg", po::value<std::string>()->required(), "output configuration");
     pos.add("textcfg", 1);
 
     po::variables_map vm;
     try {
-        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos).run();
+        po::parsed_options parsed = po::command_line_parser(argc, argv).options(options).positional(pos)
+                .extra_parser(stats_parser).run();
         po::store(parsed, vm);
         po::notify(vm);
     }
@@ -59,6 +66,11 @@ help:
         return vm.count("help") ? 0 : 1;
     }
 
+    if (vm.count("stats") && !enable_stats(vm["stats"].as<string>())) {
+        cerr << "Error: --stats format must be text or json" << endl << endl;
+        goto help;
+    }
+
     ifstream bit_file(vm["input"].as<string>(), ios::binary);
     if (!bit_file) {
         cerr << "Failed to open input file" << endl;
@@ -79,12 +91,15 @@ help:
     try {
         Chip c = Bitstream::read(bit_file).deserialise_chip();
         ChipConfig cc = ChipConfig::from_chip(c);
-        ofstream out_file(vm["textcfg"].as<string>());
+        ofstream out_file(vm["textcfg"].as<string>(), vm.count("binary") ? ios::out | ios::binary : ios::out);
         if (!out_file) {
             cerr << "Failed to open output file" << endl;
             return 1;
         }
-        out_file << cc.to_string();
+        PhaseTimer timer(Phase::WRITE);
+        string output = vm.count("binary") ? BinaryChipConfig::encode(cc) : cc.to_string();
+        out_file << output;
+        Metrics::add(Counter::BYTES_WRITTEN, output.size());
         return 0;
     } catch (BitstreamParseError &e) {
         cerr << "Failed to process input bitstream: " << e.what() << endl;
@@ -0,0 +1,41 @@
+#include "toolstats.hpp"
+#include "Metrics.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// The default operator delete frees what this allocates
+void *operator new(std::size_t size)
+{
+    Tang::Metrics::add(Tang::Counter::ALLOCATIONS);
+    void *p = std::malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+std::pair<std::string, std::string> stats_parser(const std::string &arg)
+{
+    if (arg == "--stats")
+        return std::make_pair(std::string("stats"), std::string("text"));
+    if (arg.compare(0, 8, "--stats=") == 0)
+        return std::make_pair(std::string("stats"), arg.substr(8));
+    return std::make_pair(std::string(), std::string());
+}
+
+static bool stats_json = false;
+
+static void print_stats()
+{
+    std::cerr << Tang::Metrics::report(stats_json);
+}
+
+bool enable_stats(const std::string &format)
+{
+    if (format != "text" && format != "json")
+        return false;
+    stats_json = (format == "json");
+    Tang::Metrics::enable();
+    std::atexit(print_stats);
+    return true;
+}
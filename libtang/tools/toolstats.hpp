@@ -0,0 +1,17 @@
+#ifndef TANG_TOOLSTATS_HPP
+#define TANG_TOOLSTATS_HPP
+
+#include <string>
+#include <utility>
+
+// --stats support for the tools. toolstats.cpp also replaces the global operator new, so that allocations are counted
+
+// boost::program_options extra parser for --stats and --stats=format, so that a plain --stats never takes the input
+// file after it as its format
+std::pair<std::string, std::string> stats_parser(const std::string &arg);
+
+// Start recording for --stats with a format of "text" or "json", returning false for any other format. The report is
+// printed to stderr when the tool exits
+bool enable_stats(const std::string &format);
+
+#endif //TANG_TOOLSTATS_HPP